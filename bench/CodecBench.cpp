@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * microbenchmarks of the record codec, response assembly and a full
+ * round trip over a unix socket, reporting time, allocated bytes and
+ * allocations per operation.
+ */
+
+#include "asio.hpp"
+
+#include "Common.h"
+#include "EchoResponder.h"
+#include "FastCGIClient.h"
+#include "FcgiCodec.h"
+#include "ParamsBuilder.h"
+#include "ResponseSink.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const std::chrono::milliseconds MIN_RUN_TIME(200);
+static const char* UNIX_PATH = "/tmp/fcgi-codec-bench.sock";
+
+static std::atomic<uint64_t> gAllocs{ 0 };
+static std::atomic<uint64_t> gAllocBytes{ 0 };
+
+// keeps results observable so the work is not optimized away
+static volatile size_t gSink;
+
+void* operator new(size_t size)
+{
+    gAllocs.fetch_add(1, std::memory_order_relaxed);
+    gAllocBytes.fetch_add(size, std::memory_order_relaxed);
+
+    if (auto ptr = std::malloc(size))
+    {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+/**
+ * @brief run op until MIN_RUN_TIME passes and report per op costs
+ */
+template<typename Op>
+static void bench(std::string const& name, Op op)
+{
+    size_t iterations(1);
+
+    while (true)
+    {
+        const auto allocs = gAllocs.load(std::memory_order_relaxed);
+        const auto allocBytes = gAllocBytes.load(std::memory_order_relaxed);
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            op();
+        }
+
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        if ((elapsed >= MIN_RUN_TIME) || (iterations >= (1u << 30)))
+        {
+            const auto ns = std::chrono::duration<double, std::nano>(elapsed).count();
+
+            std::printf(
+                "%-44s %12.1f ns/op %12.1f B/op %8.2f allocs/op\n",
+                name.c_str(),
+                ns / iterations,
+                static_cast<double>(gAllocBytes.load(std::memory_order_relaxed) - allocBytes) / iterations,
+                static_cast<double>(gAllocs.load(std::memory_order_relaxed) - allocs) / iterations
+            );
+            return;
+        }
+
+        iterations *= 2;
+    }
+}
+
+static KeyValuePairs makeParams(size_t count)
+{
+    KeyValuePairs pairs;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        pairs.push_back({ "HTTP_X_BENCH_PARAM_" + std::to_string(i), std::string(24, 'v') });
+    }
+
+    return pairs;
+}
+
+static void benchEncode()
+{
+    for (size_t size : { 0, 64, 1024, 65535 })
+    {
+        const std::string content(size, 'c');
+
+        bench("encodeFastCgiRecord/" + std::to_string(size), [&content] {
+            gSink = encodeFastCgiRecord(5, content, 1).size();
+        });
+    }
+
+    for (size_t count : { 8, 32, 128 })
+    {
+        const auto pairs = makeParams(count);
+
+        bench("encodeNameValueParams/" + std::to_string(count), [&pairs] {
+            std::string params;
+
+            for (auto const& pair : pairs)
+            {
+                params.append(encodeNameValueParams(pair.first, pair.second));
+            }
+
+            gSink = encodeFastCgiStream(4, params, 1).size();
+        });
+
+        std::string request;
+
+        bench("paramsBuilder/" + std::to_string(count), [&pairs, &request] {
+            ParamsBuilder params;
+
+            for (auto const& pair : pairs)
+            {
+                params.add(pair.first, pair.second);
+            }
+
+            request.clear();
+            params.appendRecords(request, 1);
+            gSink = request.size();
+        });
+    }
+}
+
+static void benchDecode()
+{
+    const auto header = encodeFastCgiRecord(6, std::string(), 1);
+
+    bench("decodeFastCgiHeader", [&header] {
+        NameTagPairs fields;
+        decodeFastCgiHeader(header, fields);
+        gSink = fields.size();
+    });
+
+    for (size_t size : { 64, 1024, 65535 })
+    {
+        // a response of 16 records, decoded the way the client does
+        std::string records;
+
+        for (int i = 0; i < 16; ++i)
+        {
+            records.append(encodeFastCgiRecord(6, std::string(size, 'r'), 1));
+        }
+
+        bench("decodeRecords/16x" + std::to_string(size), [&records] {
+            std::string content;
+            size_t pos(0);
+
+            while (pos < records.size())
+            {
+                NameTagPairs fields;
+                decodeFastCgiHeader(records.substr(pos, FCGI_HEADER_SIZE), fields);
+
+                const size_t len = fields[CONT_LEN_TOKEN];
+                content.assign(records, pos + FCGI_HEADER_SIZE, len);
+                pos += FCGI_HEADER_SIZE + len + fields[PADDING_LEN_TOKEN];
+            }
+
+            gSink = content.size();
+        });
+    }
+}
+
+static void benchAssembly()
+{
+    const std::string record(FCGI_MAX_CONTENT, 'a');
+
+    for (size_t size : { 1024, 65536, 1024 * 1024 })
+    {
+        bench("responseAssembly/" + std::to_string(size), [&record, size] {
+            SinkConfig config;
+            config.memoryLimit = 16 * 1024 * 1024;
+
+            ResponseSink sink(config);
+
+            for (size_t pos = 0; pos < size; pos += record.size())
+            {
+                sink.append(record.data(), std::min(record.size(), size - pos));
+            }
+
+            std::string response;
+            sink.take(response);
+            gSink = response.size();
+        });
+    }
+}
+
+static void benchRoundTrip()
+{
+    const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = {};
+
+    addr.sun_family = AF_UNIX;
+    std::snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", UNIX_PATH);
+    ::unlink(UNIX_PATH);
+
+    if ((::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        || (::listen(listener, 16) != 0))
+    {
+        std::perror("unix listener");
+        return;
+    }
+
+    std::thread(acceptLoop, listener).detach();
+
+    const asio::local::stream_protocol::endpoint endpoint(UNIX_PATH);
+    FastCgiClient<asio::local::stream_protocol> client(endpoint);
+
+    if (!client.openConnection())
+    {
+        std::printf("roundTrip connect failed\n");
+        return;
+    }
+
+    for (size_t count : { 8, 32 })
+    {
+        for (size_t size : { 0, 1024, 65536 })
+        {
+            const auto pairs = makeParams(count);
+            const std::string body(size, 'b');
+
+            bench(
+                "roundTrip/" + std::to_string(count) + "params/" + std::to_string(size),
+                [&client, &pairs, &body] {
+                    std::string response;
+                    ReturnCode status;
+                    client.sendRequest(pairs, body, response, status);
+                    gSink = response.size();
+                }
+            );
+        }
+    }
+
+    ::unlink(UNIX_PATH);
+}
+
+int main()
+{
+    ILogger::setLevel(ILogger::Level::WARN_LEVEL);
+
+    benchEncode();
+    benchDecode();
+    benchAssembly();
+    benchRoundTrip();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BENCH_ECHORESPONDER_H_
+#define BENCH_ECHORESPONDER_H_
+
+/*
+ * minimal in-process fcgi responder for the benchmarks, answering each
+ * request with a status line followed by the request body
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+static bool readFully(int fd, char* buf, size_t len)
+{
+    while (len > 0)
+    {
+        const auto got = ::read(fd, buf, len);
+
+        if (got <= 0)
+        {
+            return false;
+        }
+
+        buf += got;
+        len -= static_cast<size_t>(got);
+    }
+
+    return true;
+}
+
+static void appendRecord(std::string& out, int type, int id, std::string const& content)
+{
+    const char hdr[8] = {
+        1, static_cast<char>(type),
+        static_cast<char>(id >> 8), static_cast<char>(id & 0xFF),
+        static_cast<char>(content.size() >> 8), static_cast<char>(content.size() & 0xFF),
+        0, 0
+    };
+
+    out.append(hdr, sizeof(hdr));
+    out.append(content);
+}
+
+// answers every request with its body, one thread per connection
+static void serveConnection(int fd)
+{
+    char hdr[8];
+    std::string stdinData;
+    std::vector<char> content;
+
+    while (readFully(fd, hdr, sizeof(hdr)))
+    {
+        const int type = static_cast<unsigned char>(hdr[1]);
+        const int id = (static_cast<unsigned char>(hdr[2]) << 8) | static_cast<unsigned char>(hdr[3]);
+        const size_t len = (static_cast<unsigned char>(hdr[4]) << 8) | static_cast<unsigned char>(hdr[5]);
+        const size_t padding = static_cast<unsigned char>(hdr[6]);
+
+        content.resize(len + padding);
+
+        if (!readFully(fd, content.data(), content.size()))
+        {
+            break;
+        }
+
+        if (type != 5)
+        {
+            continue;
+        }
+
+        if (len > 0)
+        {
+            stdinData.append(content.data(), len);
+            continue;
+        }
+
+        // split the reply into records of at most 32KB
+        const std::string body = "Status: 200 OK\r\n\r\n" + stdinData;
+        std::string reply;
+
+        for (size_t pos = 0; pos < body.size(); pos += 32768)
+        {
+            appendRecord(reply, 6, id, body.substr(pos, 32768));
+        }
+
+        appendRecord(reply, 6, id, std::string());
+        appendRecord(reply, 3, id, std::string(8, '\0'));
+        stdinData.clear();
+
+        if (::write(fd, reply.data(), reply.size()) != static_cast<ssize_t>(reply.size()))
+        {
+            break;
+        }
+    }
+
+    ::close(fd);
+}
+
+static void acceptLoop(int listener)
+{
+    while (true)
+    {
+        const int fd = ::accept(listener, nullptr, nullptr);
+
+        if (fd < 0)
+        {
+            return;
+        }
+
+        std::thread(serveConnection, fd).detach();
+    }
+}
+
+#endif /* BENCH_ECHORESPONDER_H_ */
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * round trip latency of small requests against an in-process echo
+ * responder, comparing transport profiles over tcp and unix sockets.
+ */
+
+#include "asio.hpp"
+
+#include "Common.h"
+#include "EchoResponder.h"
+#include "FastCGIClient.h"
+#include "TransportProfile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const size_t ROUND_TRIPS = 20000;
+static const size_t WARM_UP = 1000;
+static const char* UNIX_PATH = "/tmp/fcgi-transport-bench.sock";
+
+template<typename Protocol>
+static void measure(
+    char const* label,
+    typename Protocol::endpoint const& endpoint,
+    TransportProfile const& profile
+)
+{
+    FastCgiClient<Protocol> client(endpoint, profile);
+
+    if (!client.openConnection())
+    {
+        std::printf("%-24s connect failed\n", label);
+        return;
+    }
+
+    const KeyValuePairs pairs {
+        { "REQUEST_METHOD", "POST" },
+        { "REQUEST_URI", "/bench" },
+    };
+    const std::string body(256, 'x');
+    std::string response;
+    ReturnCode status;
+    std::vector<double> samples;
+
+    samples.reserve(ROUND_TRIPS);
+
+    for (size_t i = 0; i < WARM_UP + ROUND_TRIPS; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        if (!client.sendRequest(pairs, body, response, status))
+        {
+            std::printf("%-24s request failed\n", label);
+            return;
+        }
+
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        if (i >= WARM_UP)
+        {
+            samples.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+        }
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    auto at = [&samples] (double q) {
+        return samples[std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()))];
+    };
+
+    std::printf(
+        "%-24s p50 %8.1fus  p99 %8.1fus  p99.9 %8.1fus\n",
+        label, at(0.5), at(0.99), at(0.999)
+    );
+}
+
+int main()
+{
+    const int tcpListener = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in tcpAddr = {};
+    socklen_t tcpLen = sizeof(tcpAddr);
+
+    tcpAddr.sin_family = AF_INET;
+    tcpAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if ((::bind(tcpListener, reinterpret_cast<sockaddr*>(&tcpAddr), sizeof(tcpAddr)) != 0)
+        || (::listen(tcpListener, 16) != 0)
+        || (::getsockname(tcpListener, reinterpret_cast<sockaddr*>(&tcpAddr), &tcpLen) != 0))
+    {
+        std::perror("tcp listener");
+        return EXIT_FAILURE;
+    }
+
+    const int unixListener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un unixAddr = {};
+
+    unixAddr.sun_family = AF_UNIX;
+    std::snprintf(unixAddr.sun_path, sizeof(unixAddr.sun_path), "%s", UNIX_PATH);
+    ::unlink(UNIX_PATH);
+
+    if ((::bind(unixListener, reinterpret_cast<sockaddr*>(&unixAddr), sizeof(unixAddr)) != 0)
+        || (::listen(unixListener, 16) != 0))
+    {
+        std::perror("unix listener");
+        return EXIT_FAILURE;
+    }
+
+    std::thread(acceptLoop, tcpListener).detach();
+    std::thread(acceptLoop, unixListener).detach();
+
+    const asio::ip::tcp::endpoint tcpEndpoint(asio::ip::address_v4::loopback(), ntohs(tcpAddr.sin_port));
+    const asio::local::stream_protocol::endpoint unixEndpoint(UNIX_PATH);
+
+    TransportProfile plain;
+    plain.noDelay = false;
+
+    TransportProfile lowLatency;
+    lowLatency.quickAck = true;
+    lowLatency.busyPollUs = 50;
+
+    measure<asio::ip::tcp>("tcp, default options", tcpEndpoint, plain);
+    measure<asio::ip::tcp>("tcp, low latency", tcpEndpoint, lowLatency);
+    measure<asio::local::stream_protocol>("unix", unixEndpoint, TransportProfile());
+
+    ::unlink(UNIX_PATH);
+    return EXIT_SUCCESS;
+}
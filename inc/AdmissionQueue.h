@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_ADMISSIONQUEUE_H_
+#define INC_ADMISSIONQUEUE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <set>
+
+/*
+ * bounded queue of requests waiting for a connection, served by
+ * priority class first and earliest deadline within a class.
+ *
+ * no thread-safe class
+ */
+class AdmissionQueue final
+{
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Ticket
+    {
+        int priority;
+        Clock::time_point deadline;
+        uint64_t seq;
+    };
+
+    /**
+     * Constructor
+     *
+     * @param capacity maximum number of waiting requests
+     */
+    explicit AdmissionQueue(size_t capacity);
+
+    bool isEmpty() const;
+
+    bool isFull() const;
+
+    /**
+     * @brief enqueue a waiting request
+     *
+     * @param deadline time by which the request must complete
+     * @param priority priority class, higher is served first
+     *
+     * @return ticket identifying the waiter
+     */
+    Ticket push(Clock::time_point deadline, int priority);
+
+    /**
+     * @brief remove a waiter, either admitted or given up
+     */
+    void remove(Ticket const& ticket);
+
+    /**
+     * @brief test if waiter is next in line
+     */
+    bool isHead(Ticket const& ticket) const;
+
+    /**
+     * @brief predict queue wait plus service time of a new request
+     *
+     * @param deadline deadline of the new request
+     * @param priority priority class of the new request
+     * @param concurrency requests the servers can take in parallel
+     *
+     * @return zero until service times were recorded
+     */
+    std::chrono::microseconds predict(
+        Clock::time_point deadline,
+        int priority,
+        size_t concurrency
+    ) const;
+
+    /**
+     * @brief record service time of a completed request
+     */
+    void recordService(std::chrono::microseconds service);
+
+private:
+
+    struct Earlier
+    {
+        bool operator()(Ticket const& lhs, Ticket const& rhs) const;
+    };
+
+    std::set<Ticket, Earlier> m_waiters;
+    size_t m_capacity;
+    uint64_t m_seq = 0;
+    double m_serviceUs = 0.0;
+};
+
+#endif /* INC_ADMISSIONQUEUE_H_ */
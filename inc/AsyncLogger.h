@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_ASYNCLOGGER_H_
+#define INC_ASYNCLOGGER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ILogger.h"
+
+/*
+ * logger formatting and writing records on a background thread.
+ *
+ * Each logging thread captures its records into its own ring, so
+ * callers never wait on each other or on stdout. Records that find the
+ * ring full are dropped and counted. Messages longer than a ring slot
+ * are truncated.
+ *
+ * thread-safe class
+ */
+class AsyncLogger final : public ILogger
+{
+public:
+
+    static const size_t RING_CAPACITY;
+    static const size_t MAX_MESSAGE = 256;
+
+    AsyncLogger();
+
+    /**
+     * @brief write pending records and stop the background thread
+     */
+    ~AsyncLogger();
+
+    void setLogLevel(Level logLevel) override;
+
+    void info(const char* const fileName, unsigned long line, const char* const fmt...) override;
+
+    void debug(const char* const fileName, unsigned long line, const char* const fmt...) override;
+
+    void warn(const char* const fileName, unsigned long line, const char* const fmt...) override;
+
+    void error(const char* const fileName, unsigned long line, const char* const fmt...) override;
+
+    void fatal(const char* const fileName, unsigned long line, const char* const fmt...) override;
+
+private:
+
+    struct Record
+    {
+        std::chrono::system_clock::time_point time;
+        const char* fileName;
+        unsigned long line;
+        Level level;
+        char message[MAX_MESSAGE];
+    };
+
+    /*
+     * single producer, single consumer ring
+     */
+    struct Ring
+    {
+        explicit Ring(size_t capacity);
+
+        std::vector<Record> slots;
+        std::atomic<size_t> head{ 0 };
+        std::atomic<size_t> tail{ 0 };
+        std::atomic<size_t> dropped{ 0 };
+
+        // cleared when the logging thread exits, the ring is then reused
+        std::atomic<bool> owned{ true };
+    };
+
+    AsyncLogger(AsyncLogger const&) = delete;
+    AsyncLogger& operator=(AsyncLogger const&) = delete;
+
+    bool isLoggable(Level logLevel) const;
+
+    void log(
+        Level logLevel,
+        const char* const fileName,
+        unsigned long line,
+        const char* const fmt,
+        va_list& arg
+    );
+
+    Ring& localRing();
+
+    void run();
+
+    void write(std::vector<Record>& batch, size_t dropped);
+
+    const uint64_t m_id;
+    std::atomic<Level> m_level{ Level::INFO_LEVEL };
+    std::mutex m_sync;
+    std::condition_variable m_wakeup;
+    std::vector<std::shared_ptr<Ring>> m_rings;
+    bool m_stop = false;
+    std::thread m_worker;
+};
+
+#endif /* INC_ASYNCLOGGER_H_ */
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_CAPTURE_H_
+#define INC_CAPTURE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class CaptureEvent : uint8_t
+{
+    REQUEST = 1,    // encoded request records, as written
+    RECORD  = 2,    // one received record, header and content
+};
+
+/*
+ * one event read back from a capture file
+ */
+struct CapturedEvent
+{
+    CaptureEvent event = CaptureEvent::REQUEST;
+    uint16_t requestId = 0;
+    uint32_t connection = 0;
+
+    // time since the capture was opened
+    std::chrono::nanoseconds at{ 0 };
+
+    std::string payload;
+};
+
+struct CaptureConfig
+{
+    // share of requests captured, from 0 to 1
+    double sampleRate = 1.0;
+
+    // capturing stops once the file would grow past this size
+    uint64_t maxBytes = 1ULL << 30;
+};
+
+/*
+ * append-only binary capture of fcgi traffic. A file starts with the
+ * magic "FCGICAP1" followed by events, each a 20 byte header of payload
+ * length (uint32), event, a reserved byte, request id (uint16),
+ * connection (uint32) and nanoseconds since opening (uint64), in host
+ * byte order, then the payload.
+ *
+ * Clients build the events of a request in their own buffer and hand
+ * them over in one write; writers reserve their file range with an
+ * atomic add and write it with pwrite, so no lock is taken.
+ *
+ * thread-safe class
+ */
+class TrafficCapture final
+{
+public:
+
+    static const size_t EVENT_HEADER_SIZE = 20;
+
+    explicit TrafficCapture(
+        std::string const& path,
+        CaptureConfig const& config = CaptureConfig()
+    );
+
+    ~TrafficCapture();
+
+    bool isOpen() const;
+
+    /**
+     * @brief id of a new connection, events of one connection are
+     * serial
+     */
+    uint32_t connectionId();
+
+    /**
+     * @brief decide whether to capture the next request
+     */
+    bool sample();
+
+    /**
+     * @brief append an event stamped with the current time to batch
+     */
+    void appendEvent(
+        std::string& batch,
+        CaptureEvent event,
+        uint16_t requestId,
+        uint32_t connection,
+        char const* data,
+        size_t len
+    ) const;
+
+    /**
+     * @brief append batch to the file
+     *
+     * @return false if the file is full or the write failed
+     */
+    bool write(std::string const& batch);
+
+    /**
+     * @brief batches dropped because the file was full or unwritable
+     */
+    uint64_t dropped() const;
+
+    /**
+     * @brief read the events of a capture file in file order
+     *
+     * @return false if the file is not a capture, events read up to a
+     * truncated or corrupt tail are kept
+     */
+    static bool load(std::string const& path, std::vector<CapturedEvent>& events);
+
+    TrafficCapture(TrafficCapture const&) = delete;
+    TrafficCapture& operator=(TrafficCapture const&) = delete;
+
+private:
+
+    int m_fd;
+    CaptureConfig m_config;
+    uint64_t m_stride;
+    std::chrono::steady_clock::time_point m_opened;
+    std::atomic<uint64_t> m_offset;
+    std::atomic<uint64_t> m_sequence{ 0 };
+    std::atomic<uint32_t> m_connections{ 0 };
+    std::atomic<uint64_t> m_dropped{ 0 };
+};
+
+#endif /* INC_CAPTURE_H_ */
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_CGIHEADERS_H_
+#define INC_CGIHEADERS_H_
+
+#include <string>
+
+#include "Common.h"
+
+/**
+ * @brief split the header block off a cgi response
+ *
+ * @param response cgi response, headers followed by an empty line and body
+ * @param headers receives header names and trimmed values in order
+ * @param bodyOffset receives offset of the body within response
+ *
+ * @return false if response has no complete header block
+ */
+bool parseCgiHeaders(
+    std::string const& response,
+    KeyValuePairs& headers,
+    size_t& bodyOffset
+);
+
+/**
+ * @brief strip surrounding blanks and carriage returns off a header value
+ */
+std::string trim(std::string const& str);
+
+/**
+ * @brief compare header names case-insensitively
+ */
+bool isHeader(std::string const& name, std::string const& expected);
+
+/**
+ * @brief numeric cgi Status of a response
+ *
+ * @return value of the Status header, 200 when absent
+ */
+int cgiStatus(KeyValuePairs const& headers);
+
+#endif /* INC_CGIHEADERS_H_ */
@@ -34,6 +34,7 @@
 #ifndef INC_COMMON_H_
 #define INC_COMMON_H_
 
+#include <chrono>
 #include <cstdint>
 #include <map>
 #include <string>
@@ -45,10 +46,27 @@ enum class ReturnCode
     IO_ERROR = -1,   // read/write i/o error
     CLOSED   = -2,   // peer socket closed
     TIMEOUT  = -3,   // timer expired
+    REJECTED = -4,   // shed by client side admission control
+    TOO_LARGE = -5,  // response outgrew its memory limit
 };
 
 using KeyValuePair = std::pair<std::string, std::string>;
 using KeyValuePairs = std::vector<KeyValuePair>;
 using NameTagPairs = std::map<std::string, uint16_t>;
 
+/*
+ * per request hints for the client pool
+ */
+struct RequestOptions
+{
+    // request has no side effects and may be sent more than once
+    bool idempotent = false;
+
+    // absolute deadline, tightens the timeout when set
+    std::chrono::steady_clock::time_point deadline;
+
+    // waiting requests of a higher priority class are served first
+    int priority = 0;
+};
+
 #endif /* INC_COMMON_H_ */
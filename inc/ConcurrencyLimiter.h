@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_CONCURRENCYLIMITER_H_
+#define INC_CONCURRENCYLIMITER_H_
+
+#include <chrono>
+#include <cstdint>
+
+#include "Common.h"
+
+/*
+ * adaptive concurrency limit settings
+ */
+struct LimiterConfig
+{
+    // without a limiter only the connection count bounds concurrency
+    bool enabled = false;
+
+    size_t initialLimit = 20;
+    size_t minLimit = 1;
+    size_t maxLimit = 1000;
+
+    // weight of a new estimate against the current limit
+    double smoothing = 0.2;
+
+    // latency may grow by this factor over the minimum before the limit shrinks
+    double tolerance = 2.0;
+
+    // multiplicative decrease applied on timeouts and transport errors
+    double backoffRatio = 0.9;
+
+    // samples after which the minimum latency is measured afresh
+    uint32_t minRttWindow = 1000;
+};
+
+/*
+ * gradient based concurrency limit for one endpoint: the limit grows
+ * while latency stays near the minimum seen, shrinks as requests start
+ * queueing on the server and backs off on errors.
+ *
+ * no thread-safe class
+ */
+class ConcurrencyLimiter final
+{
+public:
+
+    /**
+     * Constructor
+     *
+     * @param config limit bounds and adaptation speed
+     */
+    explicit ConcurrencyLimiter(LimiterConfig const& config = LimiterConfig());
+
+    /**
+     * @brief requests currently allowed in flight
+     */
+    size_t limit() const;
+
+    /**
+     * @brief adapt limit to the outcome of one request
+     *
+     * @param rc OK, or the transport error which ended the request
+     * @param rtt time spent on the request
+     * @param inflight requests in flight when it completed
+     */
+    void record(ReturnCode rc, std::chrono::microseconds rtt, size_t inflight);
+
+private:
+
+    LimiterConfig m_config;
+    double m_limit;
+    int64_t m_minRtt = 0;
+    uint32_t m_samples = 0;
+};
+
+#endif /* INC_CONCURRENCYLIMITER_H_ */
@@ -34,6 +34,7 @@
 #ifndef FASTCGICLIENT_H_
 #define FASTCGICLIENT_H_
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <map>
@@ -45,12 +46,22 @@
 
 #include "asio.hpp"
 
+#include "Capture.h"
+#include "FileDataSource.h"
+#include "FileRegion.h"
+#include "Metrics.h"
+#include "ParamsBuilder.h"
+#include "ResponseSink.h"
 #include "StreamReader.h"
+#include "Trace.h"
+#include "VerdictCache.h"
 
 template<typename Protocol>
 class FastCgiClient final
 {
     static const std::chrono::seconds DEFAULT_WAIT;
+    static const std::chrono::seconds RECORD_WAIT;
+    static const size_t DEFAULT_MEMORY_LIMIT;
 
     enum FcgiRecordType
     {
@@ -67,9 +78,24 @@ class FastCgiClient final
         FCGI_TYPE_UNKOWNTYPE = 11,
     };
 
+    enum FcgiRole
+    {
+        FCGI_ROLE_RESPONDER = 1,
+        FCGI_ROLE_AUTHORIZER = 2,
+        FCGI_ROLE_FILTER = 3,
+    };
+
 public:
 
-    explicit FastCgiClient(typename Protocol::endpoint const & endpoint);
+    /**
+     * Constructor
+     *
+     * @param endpoint fcgi server address
+     * @param profile socket options of the connection
+     */
+    explicit FastCgiClient(
+        typename Protocol::endpoint const & endpoint,
+        TransportProfile const& profile = TransportProfile());
 
     ~FastCgiClient();
 
@@ -81,46 +107,279 @@ public:
         std::string& response,
         std::chrono::seconds const& timeout = DEFAULT_WAIT);
 
+    /**
+     * @brief send request and report how the exchange ended
+     *
+     * A connection broken by IO_ERROR or CLOSED is dropped and opened
+     * again by the next request.
+     *
+     * @param status OK once FCGI_END_REQUEST was received, otherwise
+     * TIMEOUT, IO_ERROR or CLOSED describing the transport failure
+     */
+    bool sendRequest(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        std::string& response,
+        ReturnCode& status,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    /**
+     * @brief send request, collecting the response into a sink
+     *
+     * Responses larger than the sink memory limit or its budget are
+     * spilled to a file instead of being held in memory.
+     */
+    bool sendRequest(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        ResponseSink& response,
+        ReturnCode& status,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    /**
+     * @brief send request with params encoded ahead by a builder
+     *
+     * The params are copied straight into the request, so a builder
+     * kept or reused by the caller saves allocating them per request.
+     * The KeyValuePairs overloads are adapters to these.
+     */
+    bool sendRequest(
+        ParamsBuilder const& params,
+        std::string const& body,
+        std::string& response,
+        ReturnCode& status,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    bool sendRequest(
+        ParamsBuilder const& params,
+        std::string const& body,
+        ResponseSink& response,
+        ReturnCode& status,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    /**
+     * @brief send request with the body read from a file descriptor
+     *
+     * The body goes from the descriptor to the socket without passing
+     * through user space, sendfile for regular files and splice for
+     * pipes. CONTENT_LENGTH is added to the params unless supplied.
+     *
+     * @param body region of a regular file, or a pipe read to its end
+     */
+    bool sendRequest(
+        KeyValuePairs const& pairs,
+        FileRegion const& body,
+        std::string& response,
+        ReturnCode& status,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    /**
+     * @brief send request with the body read from a file descriptor,
+     * collecting the response into a sink
+     */
+    bool sendRequest(
+        KeyValuePairs const& pairs,
+        FileRegion const& body,
+        ResponseSink& response,
+        ReturnCode& status,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    /**
+     * @brief send request in the FILTER role
+     *
+     * The filter input is sent as FCGI_DATA records straight from the
+     * data source windows, so large files are never copied into memory.
+     * FCGI_DATA_LENGTH and FCGI_DATA_LAST_MOD are added to the params
+     * unless supplied.
+     *
+     * @param data filter input, read to its end
+     */
+    bool sendFilterRequest(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        FileDataSource& data,
+        std::string& response,
+        ReturnCode& status,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    /**
+     * @brief ask a fcgi authorizer whether the request may proceed
+     *
+     * The request is sent in the AUTHORIZER role. When a verdict cache
+     * is set, verdicts are reused for requests carrying the same
+     * credentials.
+     *
+     * @param pairs request params, including the credentials
+     * @param verdict receives the authorizer verdict
+     *
+     * @return true if a verdict was obtained, granted or not
+     */
+    bool authorize(
+        KeyValuePairs const& pairs,
+        AuthorizerVerdict& verdict,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    /**
+     * @brief set cache of authorizer verdicts, may be shared by clients
+     */
+    void setVerdictCache(std::shared_ptr<VerdictCache> const& cache);
+
+    /**
+     * @brief record request counts and latencies into metrics, may be
+     * shared by clients
+     */
+    void setMetrics(std::shared_ptr<Metrics> const& metrics);
+
+    /**
+     * @brief trace the phases of requests carrying a trace id
+     */
+    void setTracer(std::shared_ptr<Tracer> const& tracer);
+
+    /**
+     * @brief limit the memory taken by responses returned as strings
+     *
+     * Requests whose response outgrows the limit, or the budget if set,
+     * fail with TOO_LARGE. The ResponseSink overloads spill to a file
+     * instead.
+     *
+     * @param limit bytes of one response, 64MB by default
+     * @param budget bytes of all responses in memory, may be shared by
+     * clients
+     */
+    void setMemoryLimit(size_t limit, std::shared_ptr<MemoryBudget> const& budget = nullptr);
+
+    /**
+     * @brief record a sample of requests and their response records,
+     * requests with streamed bodies are left out
+     */
+    void setCapture(std::shared_ptr<TrafficCapture> const& capture);
+
     void closeConnection();
 
+    /**
+     * @brief check an idle connection, replacing it if the server is gone
+     *
+     * Connections busy with a request or not open are left alone. The
+     * socket is peeked for end of file without blocking; with ping, the
+     * server must also answer a FCGI_GET_VALUES management record in
+     * time.
+     *
+     * @param ping send FCGI_GET_VALUES and wait for the result
+     * @param timeout maximum wait for the ping result
+     *
+     * @return false if the connection was stale and could not be reopened
+     */
+    bool probe(bool ping, std::chrono::seconds const& timeout);
+
+    /**
+     * @brief test if connection to fcgi server is open
+     */
+    bool isOpen();
+
+    /**
+     * @brief ask the fcgi server to abort the request in flight
+     *
+     * May be called from any thread. The blocked sendRequest returns
+     * once the server ends the aborted request. A request still being
+     * written is not aborted.
+     */
+    void abortRequest();
+
 private:
 
     FastCgiClient(FastCgiClient const&) = delete;
     FastCgiClient& operator=(FastCgiClient const&) = delete;
 
-    std::string encodeFastCgiRecord(
-        FcgiRecordType recType,
-        std::string const& content,
-        uint16_t requestId
+    bool exchange(
+        FcgiRole role,
+        ParamsBuilder const& params,
+        std::string const& body,
+        std::string& response,
+        ReturnCode& status,
+        std::chrono::seconds const& timeout,
+        FileDataSource* data = nullptr,
+        FileRegion const* region = nullptr
+    );
+
+    bool exchange(
+        FcgiRole role,
+        ParamsBuilder const& params,
+        std::string const& body,
+        ResponseSink& response,
+        ReturnCode& status,
+        std::chrono::seconds const& timeout,
+        FileDataSource* data = nullptr,
+        FileRegion const* region = nullptr
     );
 
-    std::string encodeNameValueParams(
-        std::string const& name,
-        std::string const& value
+    ReturnCode writeFastCgiStream(
+        FcgiRecordType recType,
+        FileDataSource& source,
+        uint16_t requestId,
+        size_t& sent
     );
 
-    bool decodeFastCgiHeader(std::string const& buf, NameTagPairs& pairs);
+    ReturnCode writeFastCgiStream(
+        FcgiRecordType recType,
+        FileRegion const& region,
+        uint16_t requestId,
+        std::chrono::steady_clock::time_point expire,
+        size_t& sent
+    );
 
-    bool decodeFastCgiRecord(
+    ReturnCode decodeFastCgiRecord(
         FcgiRecordType& type,
         uint16_t& requestId,
-        std::string& content
+        std::string& content,
+        std::chrono::seconds const& wait = RECORD_WAIT
     );
 
     bool waitForResponse(
         uint16_t requestId,
-        std::string& response,
+        ResponseSink& response,
+        ReturnCode& status,
         std::chrono::seconds const& timeout
     );
 
+    bool connect();
+
+    /**
+     * @brief take the connection lock, noting when the request arrived
+     */
+    std::unique_lock<std::mutex> lockRequest();
+
+    void recordMetrics(
+        size_t sent,
+        size_t received,
+        ReturnCode status,
+        std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point written
+    );
+
     void run();
 
     typename Protocol::endpoint m_endpoint;
+    std::string m_label;
+    TransportProfile m_profile;
     asio::io_context m_ioCtx;
     asio::executor_work_guard<asio::io_context::executor_type> m_guard;
     StreamReader<Protocol> m_reader;
     std::thread m_worker;
     std::mutex m_sync;
+    // serializes request writes with abort records from the worker thread
+    std::mutex m_writeSync;
+    std::atomic<uint16_t> m_activeRequestId{ 0 };
+    std::shared_ptr<VerdictCache> m_verdictCache;
+    std::shared_ptr<EndpointMetrics> m_metrics;
+    std::shared_ptr<Tracer> m_tracer;
+    std::shared_ptr<TrafficCapture> m_capture;
+    size_t m_memoryLimit;
+    std::shared_ptr<MemoryBudget> m_memoryBudget;
+    uint32_t m_captureId = 0;
+    bool m_capturing = false;
+    std::string m_captureBatch;
+    std::chrono::steady_clock::time_point m_entered;
+    std::chrono::steady_clock::time_point m_firstRecord;
 };
 
 #include "FastCGIClientImpl.h"
@@ -37,48 +37,45 @@
 #include <ctime>
 #include <sstream>
 
+#include "FcgiCodec.h"
 #include "ILogger.h"
+#include "Probes.h"
 
-namespace
-{
-    enum FcgiRole
-    {
-        FCGI_ROLE_RESPONDER = 1,
-        FCGI_ROLE_AUTHORIZER = 2,
-        FCGI_ROLE_FILTER = 3,
-    };
-
-}
+static const std::string CONTENT_LENGTH_PARAM("CONTENT_LENGTH");
+static const std::string DATA_LENGTH_PARAM("FCGI_DATA_LENGTH");
+static const std::string DATA_LAST_MOD_PARAM("FCGI_DATA_LAST_MOD");
 
-static const int FCGI_VERSION = 1;
-static const int FCGI_HEADER_SIZE = 8;
+static const std::string EMPTY_MARK;
+static const std::string MPXS_CONNS_VAR("FCGI_MPXS_CONNS");
 
-static const std::string VER_TOKEN("version");
-static const std::string TYPE_TOKEN("type");
-static const std::string REQ_ID_TOKEN("requestId");
-static const std::string CONT_LEN_TOKEN("contentLength");
-static const std::string PADDING_LEN_TOKEN("paddingLength");
+// bodies up to this size are copied into the request, larger ones are
+// written straight from the caller's string
+static const size_t COPIED_BODY_LIMIT = 4096;
 
-static const char KEEP_ALIVE = 0x01;
+template<typename Protocol>
+const std::chrono::seconds FastCgiClient<Protocol>::DEFAULT_WAIT(300);
 
-static const char FCGI_HDR[] = {
-    0x00,
-    static_cast<char>(FcgiRole::FCGI_ROLE_RESPONDER),
-    KEEP_ALIVE,
-    0x00, 0x00, 0x00, 0x00, 0x00
-};
-static const std::string FCGI_HDR_STR(FCGI_HDR, sizeof(FCGI_HDR));
-static const std::string EMPTY_MARK;
+template<typename Protocol>
+const std::chrono::seconds FastCgiClient<Protocol>::RECORD_WAIT(4);
 
 template<typename Protocol>
-const std::chrono::seconds FastCgiClient<Protocol>::DEFAULT_WAIT(300);
+const size_t FastCgiClient<Protocol>::DEFAULT_MEMORY_LIMIT(64 * 1024 * 1024);
 
 template<typename Protocol>
-FastCgiClient<Protocol>::FastCgiClient(typename Protocol::endpoint const& endpoint)
+FastCgiClient<Protocol>::FastCgiClient(
+    typename Protocol::endpoint const& endpoint,
+    TransportProfile const& profile
+)
     : m_endpoint(endpoint)
+    , m_profile(profile)
     , m_guard(m_ioCtx.get_executor())
     , m_reader(m_ioCtx)
+    , m_memoryLimit(DEFAULT_MEMORY_LIMIT)
 {
+    std::ostringstream label;
+    label << endpoint;
+    m_label = label.str();
+
     std::srand(std::time(nullptr));
     m_worker = std::thread(std::bind(&FastCgiClient::run, this));
 }
@@ -106,7 +103,81 @@ bool FastCgiClient<Protocol>::openConnection()
         return true;
     }
 
-    if (!m_reader.open(m_endpoint))
+    return connect();
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::probe(bool ping, std::chrono::seconds const& timeout)
+{
+    std::unique_lock<std::mutex> lock(m_sync, std::try_to_lock);
+
+    // a request in flight proves the connection well enough
+    if (!lock.owns_lock() || !m_reader.isOpen())
+    {
+        return true;
+    }
+
+    bool alive = m_reader.isAlive();
+
+    if (alive && ping)
+    {
+        // ask for a single variable with an empty value, request id 0
+        // marks the record as a management record
+        std::string query;
+        query.push_back(static_cast<char>(MPXS_CONNS_VAR.size()));
+        query.push_back(0);
+        query.append(MPXS_CONNS_VAR);
+
+        alive = (m_reader.write(encodeFastCgiRecord(FCGI_TYPE_GETVALUES, query, 0)) == ReturnCode::OK);
+
+        FcgiRecordType type = FCGI_TYPE_UNKOWNTYPE;
+        uint16_t requestId;
+        std::string content;
+
+        while (alive && (type != FCGI_TYPE_GETVALUES_RESULT))
+        {
+            alive = (decodeFastCgiRecord(type, requestId, content, timeout) == ReturnCode::OK)
+                && (requestId == 0);
+        }
+    }
+
+    if (alive)
+    {
+        return true;
+    }
+
+    INFO("replace stale connection (=%s).", m_label.c_str());
+    m_reader.close();
+
+    if (m_metrics)
+    {
+        m_metrics->staleConnections.add();
+    }
+
+    return connect();
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::connect()
+{
+    const auto start = std::chrono::steady_clock::now();
+    const auto opened = m_reader.open(m_endpoint, m_profile);
+
+    FCGI_PROBE2(
+        connect,
+        opened ? 1 : 0,
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()
+    );
+
+    if (m_metrics)
+    {
+        (opened ? m_metrics->connects : m_metrics->connectFailures).add();
+        m_metrics->connect.record(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start)
+        );
+    }
+
+    if (!opened)
     {
         WARN("open stream reader failed.");
         return false;
@@ -123,49 +194,564 @@ bool FastCgiClient<Protocol>::sendRequest(
     std::chrono::seconds const& timeout
 )
 {
-    std::lock_guard<std::mutex> lock(m_sync);
+    ReturnCode status;
+    return sendRequest(pairs, body, response, status, timeout);
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::sendRequest(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    std::string& response,
+    ReturnCode& status,
+    std::chrono::seconds const& timeout
+)
+{
+    return sendRequest(ParamsBuilder().add(pairs), body, response, status, timeout);
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::sendRequest(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    ResponseSink& response,
+    ReturnCode& status,
+    std::chrono::seconds const& timeout
+)
+{
+    return sendRequest(ParamsBuilder().add(pairs), body, response, status, timeout);
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::sendRequest(
+    ParamsBuilder const& params,
+    std::string const& body,
+    std::string& response,
+    ReturnCode& status,
+    std::chrono::seconds const& timeout
+)
+{
+    auto lock = lockRequest();
+    return exchange(FCGI_ROLE_RESPONDER, params, body, response, status, timeout);
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::sendRequest(
+    ParamsBuilder const& params,
+    std::string const& body,
+    ResponseSink& response,
+    ReturnCode& status,
+    std::chrono::seconds const& timeout
+)
+{
+    auto lock = lockRequest();
+    return exchange(FCGI_ROLE_RESPONDER, params, body, response, status, timeout);
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::sendRequest(
+    KeyValuePairs const& pairs,
+    FileRegion const& body,
+    std::string& response,
+    ReturnCode& status,
+    std::chrono::seconds const& timeout
+)
+{
+    // string responses live in memory, bounded by the client limits
+    SinkConfig config;
+    std::shared_ptr<MemoryBudget> budget;
+    config.spill = false;
 
-    if (!m_reader.isOpen())
     {
-        WARN("stream reader not opened yet.");
+        std::lock_guard<std::mutex> lock(m_sync);
+        config.memoryLimit = m_memoryLimit;
+        budget = m_memoryBudget;
+    }
+
+    ResponseSink sink(config, budget);
+    const auto ret = sendRequest(pairs, body, sink, status, timeout);
+
+    sink.take(response);
+    return ret;
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::sendRequest(
+    KeyValuePairs const& pairs,
+    FileRegion const& body,
+    ResponseSink& response,
+    ReturnCode& status,
+    std::chrono::seconds const& timeout
+)
+{
+    auto region = body;
+    size_t fileSize;
+
+    if (region.fd < 0)
+    {
+        WARN("invalid body descriptor (=%d).", region.fd);
+        status = ReturnCode::IO_ERROR;
         return false;
     }
 
-    const uint16_t requestId = (std::rand() & 0x7fff);
-    auto request = encodeFastCgiRecord(FCGI_TYPE_BEGIN, FCGI_HDR_STR, requestId);
+    if (region.isRegularFile(fileSize))
+    {
+        if ((region.offset < 0) || (static_cast<size_t>(region.offset) > fileSize)
+            || ((region.length > 0) && (region.length > fileSize - region.offset)))
+        {
+            WARN("body region out of file bounds.");
+            status = ReturnCode::IO_ERROR;
+            return false;
+        }
+
+        if (region.length == 0)
+        {
+            region.length = fileSize - region.offset;
+        }
+    }
+
+    ParamsBuilder params;
+    params.add(pairs);
 
-    if (!pairs.empty())
+    if (!params.contains(CONTENT_LENGTH_PARAM) && (region.length > 0))
     {
-        std::string paramsRecord;
+        params.add(CONTENT_LENGTH_PARAM, static_cast<int64_t>(region.length));
+    }
 
-        std::for_each(pairs.begin(), pairs.end(), [&, this] (auto& pair) {
-            paramsRecord.append(encodeNameValueParams(pair.first, pair.second));
-        });
+    auto lock = lockRequest();
+    return exchange(FCGI_ROLE_RESPONDER, params, EMPTY_MARK, response, status, timeout, nullptr, &region);
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::sendFilterRequest(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    FileDataSource& data,
+    std::string& response,
+    ReturnCode& status,
+    std::chrono::seconds const& timeout
+)
+{
+    if (!data.isValid())
+    {
+        WARN("invalid filter data source.");
+        status = ReturnCode::IO_ERROR;
+        return false;
+    }
+
+    ParamsBuilder params;
+    params.add(pairs);
+    size_t dataLen;
+
+    if (!params.contains(DATA_LENGTH_PARAM) && data.length(dataLen))
+    {
+        params.add(DATA_LENGTH_PARAM, static_cast<int64_t>(dataLen));
+    }
+
+    if (!params.contains(DATA_LAST_MOD_PARAM))
+    {
+        params.add(DATA_LAST_MOD_PARAM, static_cast<int64_t>(data.lastModified()));
+    }
+
+    auto lock = lockRequest();
+    return exchange(FCGI_ROLE_FILTER, params, body, response, status, timeout, &data);
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::authorize(
+    KeyValuePairs const& pairs,
+    AuthorizerVerdict& verdict,
+    std::chrono::seconds const& timeout
+)
+{
+    std::shared_ptr<VerdictCache> cache;
+    std::string cacheKey;
+
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+        cache = m_verdictCache;
+    }
+
+    const auto cacheable = cache && cache->key(pairs, cacheKey);
+
+    if (cacheable && cache->lookup(cacheKey, verdict))
+    {
+        return true;
+    }
 
-        if (!paramsRecord.empty())
+    std::string response;
+    ReturnCode status;
+    bool ret(false);
+
+    {
+        auto lock = lockRequest();
+        ret = exchange(FCGI_ROLE_AUTHORIZER, ParamsBuilder().add(pairs), EMPTY_MARK, response, status, timeout);
+    }
+
+    if (!ret || !verdict.parse(response))
+    {
+        WARN("no verdict from authorizer, code (=%d).", static_cast<int>(status));
+        return false;
+    }
+
+    if (cacheable)
+    {
+        cache->store(cacheKey, verdict);
+    }
+
+    return true;
+}
+
+template<typename Protocol>
+void FastCgiClient<Protocol>::setVerdictCache(std::shared_ptr<VerdictCache> const& cache)
+{
+    std::lock_guard<std::mutex> lock(m_sync);
+    m_verdictCache = cache;
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::exchange(
+    FcgiRole role,
+    ParamsBuilder const& params,
+    std::string const& body,
+    std::string& response,
+    ReturnCode& status,
+    std::chrono::seconds const& timeout,
+    FileDataSource* data,
+    FileRegion const* region
+)
+{
+    // string responses live in memory, bounded by the client limits
+    SinkConfig config;
+    config.memoryLimit = m_memoryLimit;
+    config.spill = false;
+
+    ResponseSink sink(config, m_memoryBudget);
+    const auto ret = exchange(role, params, body, sink, status, timeout, data, region);
+
+    sink.take(response);
+    return ret;
+}
+
+template<typename Protocol>
+bool FastCgiClient<Protocol>::exchange(
+    FcgiRole role,
+    ParamsBuilder const& params,
+    std::string const& body,
+    ResponseSink& response,
+    ReturnCode& status,
+    std::chrono::seconds const& timeout,
+    FileDataSource* data,
+    FileRegion const* region
+)
+{
+    if (!m_reader.isOpen() && !connect())
+    {
+        WARN("connection to fcgi server unavailable.");
+        status = ReturnCode::CLOSED;
+        return false;
+    }
+
+    // a connection the server dropped while idle would swallow the
+    // request and leave us waiting for the timeout
+    if (!m_reader.isAlive())
+    {
+        INFO("replace stale connection (=%s).", m_label.c_str());
+        m_reader.close();
+
+        if (m_metrics)
+        {
+            m_metrics->staleConnections.add();
+        }
+
+        if (!connect())
         {
-            request.append(encodeFastCgiRecord(FCGI_TYPE_PARAMS, paramsRecord, requestId));
+            status = ReturnCode::CLOSED;
+            return false;
         }
     }
 
+    // request id 0 is reserved for management records
+    const uint16_t requestId = (std::rand() % 0x7fff) + 1;
+    const auto start = std::chrono::steady_clock::now();
+    TraceSpan span;
+    const bool traced = m_tracer && m_tracer->begin(params, span);
+
+    if (traced)
+    {
+        span.endpoint = m_label;
+        span.requestId = requestId;
+        span.wallStart = std::chrono::system_clock::now() - (start - m_entered);
+        span.entered = m_entered;
+        span.acquired = start;
+    }
+
+    // authorizers receive no content stream, region bodies follow the request
+    const bool withStdin = (role != FCGI_ROLE_AUTHORIZER) && (region == nullptr);
+    const bool copyBody = withStdin && (body.size() <= COPIED_BODY_LIMIT);
+    const auto bodyRecords = withStdin ? (body.size() + FCGI_MAX_CONTENT - 1) / FCGI_MAX_CONTENT : 0;
+
+    // begin record, params and their end mark, a small body and its end mark
+    std::string request;
+    request.reserve(
+        FCGI_HEADER_SIZE * 4 + params.recordsSize()
+        + (copyBody ? body.size() + bodyRecords * FCGI_HEADER_SIZE : 0)
+    );
+    request.append(encodeFastCgiRecord(FCGI_TYPE_BEGIN, encodeBeginRequest(role), requestId));
+    params.appendRecords(request, requestId);
+
     // mark the end of params
     request.append(encodeFastCgiRecord(FCGI_TYPE_PARAMS, EMPTY_MARK, requestId));
 
-    if (!body.empty())
+    // a large body goes out as record headers interleaved with slices of
+    // the caller's string, in the same gathered write as the request
+    std::vector<char> stdinHeaders;
+    std::vector<asio::const_buffer> gathered;
+    size_t requestSize(request.size());
+
+    if (withStdin)
+    {
+        char hdr[FCGI_HEADER_SIZE];
+
+        if (!copyBody)
+        {
+            stdinHeaders.resize((bodyRecords + 1) * FCGI_HEADER_SIZE);
+            gathered.reserve(bodyRecords * 2 + 2);
+            gathered.push_back(asio::const_buffer(request.data(), request.size()));
+        }
+
+        for (size_t i = 0; i <= bodyRecords; ++i)
+        {
+            // the last, empty record marks the end of content
+            const auto pos = std::min(i * FCGI_MAX_CONTENT, body.size());
+            const auto len = std::min(FCGI_MAX_CONTENT, body.size() - pos);
+            char* out = copyBody ? hdr : &stdinHeaders[i * FCGI_HEADER_SIZE];
+
+            encodeFastCgiHeader(out, FCGI_TYPE_STDIN, requestId, len);
+
+            if (copyBody)
+            {
+                request.append(out, FCGI_HEADER_SIZE);
+                request.append(body.data() + pos, len);
+                continue;
+            }
+
+            gathered.push_back(asio::const_buffer(out, FCGI_HEADER_SIZE));
+
+            if (len > 0)
+            {
+                gathered.push_back(asio::const_buffer(body.data() + pos, len));
+            }
+        }
+
+        requestSize = copyBody
+            ? request.size()
+            : request.size() + stdinHeaders.size() + body.size();
+    }
+
+    span.encoded = std::chrono::steady_clock::now();
+    m_capturing = m_capture && (region == nullptr) && (data == nullptr) && m_capture->sample();
+
+    if (m_capturing)
     {
-        request.append(encodeFastCgiRecord(FCGI_TYPE_STDIN, body, requestId));
+        std::string captured;
+
+        // sampled requests only, the gathered one is joined for the capture
+        for (auto const& buffer : gathered)
+        {
+            captured.append(static_cast<const char*>(buffer.data()), buffer.size());
+        }
+
+        auto const& whole = gathered.empty() ? request : captured;
+
+        m_captureBatch.clear();
+        m_capture->appendEvent(
+            m_captureBatch, CaptureEvent::REQUEST, requestId, m_captureId, whole.data(), whole.size()
+        );
     }
 
-    // mark the end of content
-    request.append(encodeFastCgiRecord(FCGI_TYPE_STDIN, EMPTY_MARK, requestId));
+    FCGI_PROBE3(request__start, requestId, static_cast<int>(role), requestSize);
+    m_firstRecord = std::chrono::steady_clock::time_point();
+    size_t streamed(0);
 
-    if (m_reader.write(request) != ReturnCode::OK)
+    {
+        // an abort record must not land inside one of the request records
+        std::lock_guard<std::mutex> writeLock(m_writeSync);
+        status = gathered.empty() ? m_reader.write(request) : m_reader.write(gathered);
+
+        if ((status == ReturnCode::OK) && (region != nullptr))
+        {
+            status = writeFastCgiStream(FCGI_TYPE_STDIN, *region, requestId, start + timeout, streamed);
+
+            if (status == ReturnCode::OK)
+            {
+                // mark the end of content
+                status = m_reader.write(encodeFastCgiRecord(FCGI_TYPE_STDIN, EMPTY_MARK, requestId));
+            }
+        }
+
+        if ((status == ReturnCode::OK) && (data != nullptr))
+        {
+            status = writeFastCgiStream(FCGI_TYPE_DATA, *data, requestId, streamed);
+
+            if (status == ReturnCode::OK)
+            {
+                // mark the end of filter data
+                status = m_reader.write(encodeFastCgiRecord(FCGI_TYPE_DATA, EMPTY_MARK, requestId));
+            }
+        }
+
+        // only a completely written request can be aborted
+        if (status == ReturnCode::OK)
+        {
+            m_activeRequestId = requestId;
+        }
+    }
+
+    bool ret(false);
+    const bool written = (status == ReturnCode::OK);
+
+    if (!written)
     {
         WARN("write error");
-        return false;
+    }
+    else
+    {
+        span.written = std::chrono::steady_clock::now();
+        ret = waitForResponse(requestId, response, status, timeout);
+    }
+
+    {
+        // a pending abort sees the request gone before the socket closes
+        std::lock_guard<std::mutex> writeLock(m_writeSync);
+        m_activeRequestId = 0;
     }
 
-    return waitForResponse(requestId, response, timeout);
+    // a partly written request, or a response given up on partway through
+    // a record, leaves the stream out of step
+    if (!written || (status == ReturnCode::CLOSED) || (status == ReturnCode::IO_ERROR)
+        || (status == ReturnCode::TIMEOUT))
+    {
+        // reopened by the next request
+        m_reader.close();
+    }
+
+    if (m_capturing)
+    {
+        m_capture->write(m_captureBatch);
+        m_capturing = false;
+    }
+
+    FCGI_PROBE3(request__end, requestId, static_cast<int>(status), response.size());
+
+    if (traced)
+    {
+        span.status = status;
+        span.firstStdout = m_firstRecord;
+        span.ended = std::chrono::steady_clock::now();
+        m_tracer->finish(span);
+    }
+
+    if (m_metrics)
+    {
+        recordMetrics(requestSize + streamed, response.size(), status, start, span.written);
+    }
+
+    return ret;
+}
+
+template<typename Protocol>
+void FastCgiClient<Protocol>::setMetrics(std::shared_ptr<Metrics> const& metrics)
+{
+    auto endpointMetrics = metrics ? metrics->endpoint(m_label) : nullptr;
+
+    std::lock_guard<std::mutex> lock(m_sync);
+    m_metrics = endpointMetrics;
+}
+
+template<typename Protocol>
+void FastCgiClient<Protocol>::setTracer(std::shared_ptr<Tracer> const& tracer)
+{
+    std::lock_guard<std::mutex> lock(m_sync);
+    m_tracer = tracer;
+}
+
+template<typename Protocol>
+void FastCgiClient<Protocol>::setMemoryLimit(size_t limit, std::shared_ptr<MemoryBudget> const& budget)
+{
+    std::lock_guard<std::mutex> lock(m_sync);
+    m_memoryLimit = limit;
+    m_memoryBudget = budget;
+}
+
+template<typename Protocol>
+void FastCgiClient<Protocol>::setCapture(std::shared_ptr<TrafficCapture> const& capture)
+{
+    const uint32_t id = capture ? capture->connectionId() : 0;
+
+    std::lock_guard<std::mutex> lock(m_sync);
+    m_capture = capture;
+    m_captureId = id;
+}
+
+template<typename Protocol>
+std::unique_lock<std::mutex> FastCgiClient<Protocol>::lockRequest()
+{
+    const auto entered = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_sync);
+
+    m_entered = entered;
+    return lock;
+}
+
+template<typename Protocol>
+void FastCgiClient<Protocol>::recordMetrics(
+    size_t sent,
+    size_t received,
+    ReturnCode status,
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point written
+)
+{
+    if (!m_metrics)
+    {
+        return;
+    }
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    const auto now = std::chrono::steady_clock::now();
+    auto& metrics = *m_metrics;
+
+    metrics.requests.add();
+    metrics.bytesSent.add(sent);
+    metrics.bytesReceived.add(received);
+    metrics.total.record(duration_cast<microseconds>(now - start));
+
+    if (m_firstRecord != std::chrono::steady_clock::time_point())
+    {
+        metrics.firstByte.record(duration_cast<microseconds>(m_firstRecord - start));
+    }
+
+    switch (status)
+    {
+        case ReturnCode::OK:
+            metrics.server.record(duration_cast<microseconds>(now - written));
+            break;
+
+        case ReturnCode::TIMEOUT:
+            metrics.timeouts.add();
+            break;
+
+        case ReturnCode::CLOSED:
+            metrics.closed.add();
+            break;
+
+        default:
+            metrics.failures.add();
+            break;
+    }
 }
 
 template<typename Protocol>
@@ -176,104 +762,176 @@ void FastCgiClient<Protocol>::closeConnection()
 }
 
 template<typename Protocol>
-std::string FastCgiClient<Protocol>::encodeFastCgiRecord(
-    FcgiRecordType recType,
-    std::string const& content,
-    uint16_t requestId
-)
+bool FastCgiClient<Protocol>::isOpen()
 {
-    std::string rtnRecord;
-
-    const auto contentLen = content.length();
-    std::ostringstream ostr;
-    ostr << static_cast<char>(FCGI_VERSION)
-         << static_cast<char>(recType)
-         << static_cast<char>((requestId >> 8) & 0xFF)
-         << static_cast<char>(requestId & 0xFF)
-         << static_cast<char>((contentLen >> 8) & 0xFF)
-         << static_cast<char>(contentLen & 0xFF)
-         << static_cast<char>(0)
-         << static_cast<char>(0)
-         << content;
-
-    rtnRecord = ostr.str();
-    return rtnRecord;
+    std::lock_guard<std::mutex> lock(m_sync);
+    return m_reader.isOpen();
 }
 
 template<typename Protocol>
-std::string FastCgiClient<Protocol>::encodeNameValueParams(
-    std::string const& name,
-    std::string const& value
-)
+void FastCgiClient<Protocol>::abortRequest()
 {
-    std::string rtnRecord;
+    const uint16_t requestId = m_activeRequestId;
 
-    if (!name.empty() && !value.empty())
+    if (requestId == 0)
     {
-        const auto nameLen = name.length();
-        const auto valueLen = value.length();
-        std::ostringstream ostr;
+        return;
+    }
+
+    auto record = std::make_shared<std::string>(
+        encodeFastCgiRecord(FCGI_TYPE_ABORT, EMPTY_MARK, requestId)
+    );
+
+    // write from the worker thread, the requesting thread is blocked reading
+    asio::post(m_ioCtx, [this, record, requestId] () {
+        std::lock_guard<std::mutex> writeLock(m_writeSync);
 
-        if (nameLen < 128)
+        if (m_activeRequestId == requestId)
         {
-            ostr << static_cast<char>(nameLen);
+            m_reader.write(*record);
         }
-        else
+    });
+}
+
+template<typename Protocol>
+ReturnCode FastCgiClient<Protocol>::writeFastCgiStream(
+    FcgiRecordType recType,
+    FileDataSource& source,
+    uint16_t requestId,
+    size_t& sent
+)
+{
+    std::vector<char> headers;
+    std::vector<asio::const_buffer> buffers;
+    const char* window;
+    size_t windowLen;
+
+    while (source.next(window, windowLen))
+    {
+        if (windowLen == 0)
         {
-            ostr << static_cast<char>((nameLen >> 24) | 0x80)
-                 << static_cast<char>((nameLen >> 16) & 0xFF)
-                 << static_cast<char>((nameLen >> 8) & 0xFF)
-                 << static_cast<char>(nameLen & 0xFF);
+            return ReturnCode::OK;
         }
 
-        if (valueLen < 128)
+        const auto records = (windowLen + FCGI_MAX_CONTENT - 1) / FCGI_MAX_CONTENT;
+        headers.resize(records * FCGI_HEADER_SIZE);
+        buffers.clear();
+
+        // record headers interleaved with slices of the window, one gathered write
+        for (size_t i = 0; i < records; ++i)
         {
-            ostr << static_cast<char>(valueLen);
+            const auto pos = i * FCGI_MAX_CONTENT;
+            const auto len = std::min(FCGI_MAX_CONTENT, windowLen - pos);
+            char* hdr = &headers[i * FCGI_HEADER_SIZE];
+
+            encodeFastCgiHeader(hdr, recType, requestId, len);
+            buffers.push_back(asio::const_buffer(hdr, FCGI_HEADER_SIZE));
+            buffers.push_back(asio::const_buffer(window + pos, len));
         }
-        else
+
+        const auto rc = m_reader.write(buffers);
+
+        if (rc != ReturnCode::OK)
         {
-            ostr << static_cast<char>((valueLen >> 24) | 0x80)
-                 << static_cast<char>((valueLen >> 16) & 0xFF)
-                 << static_cast<char>((valueLen >> 8) & 0xFF)
-                 << static_cast<char>(valueLen & 0xFF);
+            return rc;
         }
-        ostr << name << value;
-        rtnRecord = ostr.str();
+
+        sent += windowLen + headers.size();
     }
-    return rtnRecord;
+
+    WARN("read filter data failed.");
+    return ReturnCode::IO_ERROR;
 }
 
 template<typename Protocol>
-bool FastCgiClient<Protocol>::decodeFastCgiHeader(
-    std::string const& buf,
-    NameTagPairs& pairs
+ReturnCode FastCgiClient<Protocol>::writeFastCgiStream(
+    FcgiRecordType recType,
+    FileRegion const& region,
+    uint16_t requestId,
+    std::chrono::steady_clock::time_point expire,
+    size_t& sent
 )
 {
-    pairs.clear();
-    pairs.insert({ VER_TOKEN,  buf[0] });
-    pairs.insert({ TYPE_TOKEN, buf[1] });
-    const uint16_t requestId = ((buf[2] & 0xFF) << 8) + (buf[3] & 0xFF);
-    pairs.insert({ REQ_ID_TOKEN, requestId });
-    const uint16_t len = ((buf[4] & 0xFF) << 8) + (buf[5] & 0xFF);
-    pairs.insert({ CONT_LEN_TOKEN, len });
-    pairs.insert({ PADDING_LEN_TOKEN, buf[6] });
-    return true; 
+    char hdr[FCGI_HEADER_SIZE];
+    size_t fileSize;
+    const bool regular = region.isRegularFile(fileSize);
+    off_t offset = region.offset;
+    size_t remaining = region.length;
+
+    while (!regular || (remaining > 0))
+    {
+        size_t len = FCGI_MAX_CONTENT;
+
+        // a pipe record carries what is queued, so splice never blocks mid record
+        if (!regular)
+        {
+            const auto rc = region.waitReadable(len, expire);
+
+            if (rc != ReturnCode::OK)
+            {
+                return rc;
+            }
+
+            if (len == 0)
+            {
+                break;
+            }
+
+            len = std::min(len, FCGI_MAX_CONTENT);
+        }
+
+        if (region.length > 0)
+        {
+            len = std::min(len, remaining);
+        }
+
+        encodeFastCgiHeader(hdr, recType, requestId, len);
+
+        const auto rc = m_reader.write(
+            std::string(hdr, FCGI_HEADER_SIZE),
+            region.fd,
+            regular ? &offset : nullptr,
+            len
+        );
+
+        if (rc != ReturnCode::OK)
+        {
+            return rc;
+        }
+
+        sent += FCGI_HEADER_SIZE + len;
+        remaining -= std::min(len, remaining);
+
+        if (!regular && (region.length > 0) && (remaining == 0))
+        {
+            break;
+        }
+    }
+
+    if (remaining > 0)
+    {
+        WARN("body ended early, %zu bytes missing.", remaining);
+        return ReturnCode::IO_ERROR;
+    }
+
+    return ReturnCode::OK;
 }
 
 template<typename Protocol>
-bool FastCgiClient<Protocol>::decodeFastCgiRecord(
+ReturnCode FastCgiClient<Protocol>::decodeFastCgiRecord(
     FcgiRecordType& type,
     uint16_t& requestId,
-    std::string& content
+    std::string& content,
+    std::chrono::seconds const& wait
 )
 {
-    static const auto ns = std::chrono::seconds(4);
     char hdr[FCGI_HEADER_SIZE] = { 0 };
+    auto rc = m_reader.read(hdr, sizeof(hdr), wait);
 
-    if (m_reader.read(hdr, sizeof(hdr), ns) != ReturnCode::OK)
+    if (rc != ReturnCode::OK)
     {
         WARN("read fcgi header error");
-        return false;
+        return rc;
     }
 
     NameTagPairs hdrPairs;
@@ -283,73 +941,101 @@ bool FastCgiClient<Protocol>::decodeFastCgiRecord(
     const auto contentLen = hdrPairs[CONT_LEN_TOKEN];
     const auto paddingLen = hdrPairs[PADDING_LEN_TOKEN];
 
+    FCGI_PROBE3(record__decode, requestId, static_cast<int>(type), contentLen);
+
+    // empty records, such as end of stream marks, carry no content
+    content.resize(contentLen);
+
     if (contentLen > 0)
     {
-        std::unique_ptr<char[]> pContentBuf(new char[contentLen]);
+        rc = m_reader.read(&content[0], contentLen, wait);
 
-        if (m_reader.read(
-                pContentBuf.get(), contentLen, ns
-            ) != ReturnCode::OK)
+        if (rc != ReturnCode::OK)
         {
             WARN("read content error");
-            return false;
+            return rc;
         }
+    }
 
-        content.assign(pContentBuf.get(), contentLen);
+    if (m_capturing)
+    {
+        std::string record(hdr, sizeof(hdr));
+        record.append(content);
+        m_capture->appendEvent(
+            m_captureBatch, CaptureEvent::RECORD, requestId, m_captureId, record.data(), record.size()
+        );
     }
 
     if (paddingLen > 0)
     {
         std::unique_ptr<char[]> pPadding(new char[paddingLen]);
 
-        if (m_reader.read(
-                pPadding.get(), paddingLen, ns
-            ) != ReturnCode::OK)
+        rc = m_reader.read(pPadding.get(), paddingLen, wait);
+
+        if (rc != ReturnCode::OK)
         {
             WARN("read padding error");
-            return false;
+            return rc;
         }
     }
 
-    return true;
+    return ReturnCode::OK;
 }
 
 template<typename Protocol>
 bool FastCgiClient<Protocol>::waitForResponse(
     uint16_t requestId,
-    std::string& response,
+    ResponseSink& response,
+    ReturnCode& status,
     std::chrono::seconds const& timeout
 )
 {
     FcgiRecordType type;
     uint16_t rcvdReqId;
     std::string content;
+    std::string errors;
+    bool sinkFailed(false);
     bool ret(false);
     const auto expire = std::chrono::steady_clock::now() + timeout;
 
     while (true)
     {
-        if (!decodeFastCgiRecord(type, rcvdReqId, content))
+        status = decodeFastCgiRecord(type, rcvdReqId, content);
+
+        if (status != ReturnCode::OK)
         {
             WARN("recv fcgi record failed");
+
+            if ((status == ReturnCode::CLOSED) || (status == ReturnCode::IO_ERROR))
+            {
+                // connection is gone, no point waiting until expiry
+                break;
+            }
         }
         else
         {
+            if ((type == FCGI_TYPE_STDOUT) && (rcvdReqId == requestId)
+                && (m_firstRecord == std::chrono::steady_clock::time_point()))
+            {
+                m_firstRecord = std::chrono::steady_clock::now();
+            }
+
             if ((type == FCGI_TYPE_STDOUT) || (type == FCGI_TYPE_STDERR))
             {
                 if (rcvdReqId != requestId)
                 {
                     WARN("fcgi record request id does not match, expected (=%d).", rcvdReqId);
                 }
+                else if (type == FCGI_TYPE_STDOUT)
+                {
+                    // the response may span many records, keep reading
+                    // to the end even if the sink failed
+                    sinkFailed = sinkFailed || !response.append(content.data(), content.length());
+                    ret = true;
+                }
                 else
                 {
-                    response = content;
-
-                    if (type == FCGI_TYPE_STDOUT)
-                    {
-                        // received error or response
-                        ret = true;
-                    }
+                    errors.append(content);
                 }
             }
 
@@ -362,10 +1048,30 @@ bool FastCgiClient<Protocol>::waitForResponse(
         if (std::chrono::steady_clock::now() > expire)
         {
             WARN("request time out.");
+            FCGI_PROBE1(request__timeout, requestId);
+            status = ReturnCode::TIMEOUT;
             break;
         }
     }
 
+    if (!errors.empty())
+    {
+        WARN("fcgi server reported error (=%s).", errors.c_str());
+
+        // without a response the error output is all there is to return
+        if (!ret)
+        {
+            response.append(errors.data(), errors.length());
+        }
+    }
+
+    if (sinkFailed)
+    {
+        WARN("response sink failed, response incomplete.");
+        status = response.isOverLimit() ? ReturnCode::TOO_LARGE : ReturnCode::IO_ERROR;
+        return false;
+    }
+
     return ret;
 }
 
@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_FASTCGICLIENTPOOL_H_
+#define INC_FASTCGICLIENTPOOL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "AdmissionQueue.h"
+#include "Common.h"
+#include "ConcurrencyLimiter.h"
+#include "FastCGIClient.h"
+#include "HedgePolicy.h"
+#include "Metrics.h"
+#include "OutlierDetector.h"
+#include "ResponseCache.h"
+#include "RetryBudget.h"
+#include "Trace.h"
+#include "TransportProfile.h"
+
+/*
+ * liveness checks of idle connections, each checked connection is kept
+ * out of selection until its check completes
+ */
+struct HealthConfig
+{
+    // period of the checks, 0 disables them
+    std::chrono::milliseconds interval{ 0 };
+
+    // every that many checks also ping the server with FCGI_GET_VALUES,
+    // 0 only peeks for connections closed by the server
+    size_t pingEvery = 0;
+
+    // time a ping may take before the connection counts as dead
+    std::chrono::seconds pingTimeout{ 1 };
+};
+
+/*
+ * client pool settings
+ */
+struct PoolConfig
+{
+    // connections kept to each server
+    size_t connectionsPerEndpoint = 1;
+
+    // socket options of every connection
+    TransportProfile transport;
+
+    // ejection thresholds for slow servers
+    OutlierConfig outlier;
+
+    // hedging of idempotent requests
+    HedgeConfig hedge;
+
+    // retries of idempotent requests failed on a broken connection
+    RetryConfig retry;
+
+    // adaptive limit of requests in flight per server
+    LimiterConfig limiter;
+
+    // requests allowed to wait for a connection, further ones are rejected
+    size_t maxWaiting = 64;
+
+    // identical idempotent requests in flight share one server round trip
+    bool coalesce = false;
+
+    // responses of idempotent requests without body served from memory
+    CacheConfig cache;
+
+    // background replacement of idle connections closed by the server
+    HealthConfig health;
+
+    // request counts and latencies of every connection, if set
+    std::shared_ptr<Metrics> metrics;
+
+    // phase timing of requests carrying a trace id, if set
+    std::shared_ptr<Tracer> tracer;
+
+    // wire level capture of a sample of requests, if set
+    std::shared_ptr<TrafficCapture> capture;
+
+    // bytes of one response returned as a string, larger ones fail
+    // with TOO_LARGE; use the ResponseSink overload to spill them
+    size_t responseMemoryLimit = 64 * 1024 * 1024;
+
+    // bytes of all string responses held at once, 0 for no limit
+    size_t responseMemoryBudget = 0;
+};
+
+/*
+ * spreads requests over connections to several fcgi servers, keeping
+ * slow or failing servers out of selection until they recover.
+ */
+template<typename Protocol>
+class FastCgiClientPool final
+{
+    static const std::chrono::seconds DEFAULT_WAIT;
+
+public:
+
+    using Endpoints = std::vector<typename Protocol::endpoint>;
+
+    /**
+     * Constructor
+     *
+     * @param endpoints fcgi servers to balance over
+     * @param config pool settings
+     */
+    explicit FastCgiClientPool(
+        Endpoints const& endpoints,
+        PoolConfig const& config = PoolConfig()
+    );
+
+    ~FastCgiClientPool();
+
+    /**
+     * @brief open connections to all servers
+     *
+     * @return true if at least one connection was opened
+     */
+    bool openConnections();
+
+    bool sendRequest(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        std::string& response,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    /**
+     * @brief send request on the best available connection
+     *
+     * @param status OK once the request completed, TIMEOUT if no
+     * connection became free in time, REJECTED if too many requests
+     * were already waiting, or the transport error
+     */
+    bool sendRequest(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        std::string& response,
+        ReturnCode& status,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    /**
+     * @brief send request with per request hints
+     *
+     * While all connections are busy, requests wait in priority and
+     * earliest deadline order. A request is rejected up front when its
+     * predicted wait plus service time exceeds its deadline.
+     *
+     * Idempotent requests still running after the configured latency
+     * percentile are sent again on another connection, preferably to
+     * another server. The first response wins, the other request is
+     * aborted.
+     *
+     * With PoolConfig::retry, an idempotent request that failed on a
+     * broken connection before any response arrived is sent again on a
+     * fresh connection, preferably to another server, as long as the
+     * retry budget allows.
+     *
+     * With PoolConfig::coalesce, an idempotent request identical to one
+     * already in flight waits for and shares that request's response.
+     *
+     * With PoolConfig::cache, idempotent requests without body are
+     * answered from cache while the response is fresh. Stale responses
+     * within their stale-while-revalidate period are returned at once
+     * and refreshed in the background.
+     */
+    bool sendRequest(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        std::string& response,
+        ReturnCode& status,
+        RequestOptions const& options,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    /**
+     * @brief send request, sharing the response with coalesced callers
+     *
+     * @param response receives a response which may be shared with
+     * other callers of identical requests, instead of a copy
+     */
+    bool sendRequest(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        std::shared_ptr<const std::string>& response,
+        ReturnCode& status,
+        RequestOptions const& options,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    /**
+     * @brief send request, collecting the response into a sink
+     *
+     * Large responses are spilled to a file as configured in the sink,
+     * instead of failing with TOO_LARGE. Such requests are neither
+     * hedged, coalesced nor cached, which all need the response in
+     * memory; retries still apply.
+     */
+    bool sendRequest(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        ResponseSink& response,
+        ReturnCode& status,
+        RequestOptions const& options,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    void closeConnections();
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Connection
+    {
+        std::unique_ptr<FastCgiClient<Protocol>> client;
+        bool busy = false;
+    };
+
+    struct Backend
+    {
+        std::vector<Connection> connections;
+        ConcurrencyLimiter limiter;
+        size_t inflight = 0;
+    };
+
+    // state shared by the original and the hedged copy of a request
+    struct HedgedCall
+    {
+        KeyValuePairs pairs;
+        std::string body;
+        Clock::time_point expire;
+        int priority = 0;
+        size_t backend = 0;
+        std::mutex sync;
+        std::condition_variable settled;
+        std::string response[2];
+        ReturnCode status[2] = { ReturnCode::OK, ReturnCode::OK };
+        FastCgiClient<Protocol>* client[2] = { nullptr, nullptr };
+        bool started[2] = { false, false };
+        bool done[2] = { false, false };
+        bool aborted[2] = { false, false };
+        int winner = -1;
+    };
+
+    // identical request in flight, joined by coalesced callers
+    struct Flight
+    {
+        KeyValuePairs const* pairs;
+        std::string const* body;
+        std::shared_ptr<const std::string> response;
+        ReturnCode status = ReturnCode::OK;
+        bool ok = false;
+        bool landed = false;
+    };
+
+    static const size_t NO_BACKEND;
+
+    FastCgiClientPool(FastCgiClientPool const&) = delete;
+    FastCgiClientPool& operator=(FastCgiClientPool const&) = delete;
+
+    bool select(
+        size_t& backend,
+        size_t& connection,
+        Clock::time_point now,
+        size_t avoid
+    );
+
+    bool dispatch(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        std::string& response,
+        ReturnCode& status,
+        RequestOptions const& options,
+        std::chrono::seconds const& timeout
+    );
+
+    bool coalesce(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        std::shared_ptr<const std::string>& response,
+        ReturnCode& status,
+        RequestOptions const& options,
+        std::chrono::seconds const& timeout
+    );
+
+    bool roundTrip(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        std::shared_ptr<const std::string>& response,
+        ReturnCode& status,
+        RequestOptions const& options,
+        std::chrono::seconds const& timeout
+    );
+
+    bool fetch(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        std::shared_ptr<const std::string>& response,
+        ReturnCode& status,
+        RequestOptions const& options,
+        std::chrono::seconds const& timeout
+    );
+
+    void refresh(
+        KeyValuePairs const& pairs,
+        std::string const& key,
+        RequestOptions const& options,
+        std::chrono::seconds const& timeout
+    );
+
+    void track(std::future<void>&& task);
+
+    void checkHealth();
+
+    size_t capacity(Clock::time_point now) const;
+
+    ReturnCode acquire(
+        size_t& backend,
+        size_t& connection,
+        Clock::time_point expire,
+        int priority,
+        size_t avoid = NO_BACKEND
+    );
+
+    template<typename Response>
+    bool place(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        Response& response,
+        ReturnCode& status,
+        RequestOptions const& options,
+        Clock::time_point expire
+    );
+
+    template<typename Response>
+    bool execute(
+        size_t backend,
+        size_t connection,
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        Response& response,
+        ReturnCode& status,
+        Clock::time_point expire,
+        std::chrono::microseconds& latency
+    );
+
+    void release(
+        size_t backend,
+        size_t connection,
+        ReturnCode rc,
+        std::chrono::microseconds latency,
+        bool sample = true
+    );
+
+    bool sendHedged(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        std::string& response,
+        ReturnCode& status,
+        std::chrono::microseconds delay,
+        Clock::time_point expire,
+        int priority
+    );
+
+    /**
+     * @brief run a task on a worker thread, starting one if none is idle
+     */
+    void submit(std::function<void()>&& task);
+
+    /**
+     * @brief keep an idle worker for every queued task and due hedge,
+     * called with m_sync held
+     */
+    void spareWorker();
+
+    /**
+     * @brief worker loop, runs tasks and sends hedges as they fall due
+     */
+    void work();
+
+    void hedge(std::shared_ptr<HedgedCall> const& call);
+
+    void run(
+        std::shared_ptr<HedgedCall> const& call,
+        int slot,
+        size_t backend,
+        size_t connection
+    );
+
+    std::vector<Backend> m_backends;
+    OutlierDetector m_detector;
+    HedgePolicy m_hedge;
+    RetryBudget m_retry;
+    AdmissionQueue m_queue;
+    bool m_coalesce;
+    ResponseCache m_cache;
+    size_t m_next = 0;
+    std::mutex m_sync;
+    std::condition_variable m_released;
+    std::condition_variable m_landed;
+    std::unordered_multimap<uint64_t, std::shared_ptr<Flight>> m_flights;
+    std::list<std::future<void>> m_background;
+    HealthConfig m_health;
+    bool m_stopping = false;
+    std::condition_variable m_stop;
+    std::thread m_checker;
+    // hedged requests run on workers which are kept for reuse, at most
+    // about one per connection since every running task holds one
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::multimap<Clock::time_point, std::shared_ptr<HedgedCall>> m_hedges;
+    size_t m_idleWorkers = 0;
+    std::condition_variable m_work;
+};
+
+#include "FastCGIClientPoolImpl.h"
+
+#endif /* INC_FASTCGICLIENTPOOL_H_ */
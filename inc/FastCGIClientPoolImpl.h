@@ -0,0 +1,1054 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FastCGIClientPool.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "Fingerprint.h"
+#include "ILogger.h"
+
+template<typename Protocol>
+const std::chrono::seconds FastCgiClientPool<Protocol>::DEFAULT_WAIT(300);
+
+template<typename Protocol>
+const size_t FastCgiClientPool<Protocol>::NO_BACKEND(std::numeric_limits<size_t>::max());
+
+template<typename Protocol>
+FastCgiClientPool<Protocol>::FastCgiClientPool(
+    Endpoints const& endpoints,
+    PoolConfig const& config
+)
+    : m_backends(endpoints.size())
+    , m_detector(endpoints.size(), config.outlier)
+    , m_hedge(config.hedge)
+    , m_retry(config.retry)
+    , m_queue(config.maxWaiting)
+    , m_coalesce(config.coalesce)
+    , m_cache(config.cache)
+    , m_health(config.health)
+{
+    const auto budget = (config.responseMemoryBudget > 0)
+        ? std::make_shared<MemoryBudget>(config.responseMemoryBudget)
+        : nullptr;
+
+    for (size_t i = 0; i < endpoints.size(); ++i)
+    {
+        m_backends[i].connections.resize(std::max<size_t>(config.connectionsPerEndpoint, 1));
+        m_backends[i].limiter = ConcurrencyLimiter(config.limiter);
+
+        for (auto& conn : m_backends[i].connections)
+        {
+            conn.client.reset(new FastCgiClient<Protocol>(endpoints[i], config.transport));
+
+            if (config.metrics)
+            {
+                conn.client->setMetrics(config.metrics);
+            }
+
+            if (config.tracer)
+            {
+                conn.client->setTracer(config.tracer);
+            }
+
+            if (config.capture)
+            {
+                conn.client->setCapture(config.capture);
+            }
+
+            conn.client->setMemoryLimit(config.responseMemoryLimit, budget);
+        }
+    }
+
+    if (m_health.interval.count() > 0)
+    {
+        m_checker = std::thread(&FastCgiClientPool::checkHealth, this);
+    }
+}
+
+template<typename Protocol>
+FastCgiClientPool<Protocol>::~FastCgiClientPool()
+{
+    std::list<std::future<void>> pending;
+
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+        m_stopping = true;
+    }
+
+    m_stop.notify_all();
+    m_work.notify_all();
+
+    if (m_checker.joinable())
+    {
+        m_checker.join();
+    }
+
+    // a hedge being sent ends by its deadline, pending ones are dropped
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+        pending.swap(m_background);
+    }
+
+    // cache refreshes may still be waiting for their server
+    for (auto& task : pending)
+    {
+        task.wait();
+    }
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::openConnections()
+{
+    bool ret(false);
+
+    for (auto& backend : m_backends)
+    {
+        for (auto& conn : backend.connections)
+        {
+            if (conn.client->openConnection())
+            {
+                ret = true;
+            }
+        }
+    }
+
+    return ret;
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::sendRequest(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    std::string& response,
+    std::chrono::seconds const& timeout
+)
+{
+    ReturnCode status;
+    return sendRequest(pairs, body, response, status, RequestOptions(), timeout);
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::sendRequest(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    std::string& response,
+    ReturnCode& status,
+    std::chrono::seconds const& timeout
+)
+{
+    return sendRequest(pairs, body, response, status, RequestOptions(), timeout);
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::sendRequest(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    std::string& response,
+    ReturnCode& status,
+    RequestOptions const& options,
+    std::chrono::seconds const& timeout
+)
+{
+    const auto sharing = options.idempotent &&
+        (m_coalesce || (m_cache.isEnabled() && body.empty()));
+
+    if (!sharing)
+    {
+        return dispatch(pairs, body, response, status, options, timeout);
+    }
+
+    std::shared_ptr<const std::string> shared;
+    const auto ret = fetch(pairs, body, shared, status, options, timeout);
+
+    if (shared)
+    {
+        response = *shared;
+    }
+
+    return ret;
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::sendRequest(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    std::shared_ptr<const std::string>& response,
+    ReturnCode& status,
+    RequestOptions const& options,
+    std::chrono::seconds const& timeout
+)
+{
+    if (options.idempotent)
+    {
+        return fetch(pairs, body, response, status, options, timeout);
+    }
+
+    auto own = std::make_shared<std::string>();
+    const auto ret = dispatch(pairs, body, *own, status, options, timeout);
+    response = std::move(own);
+    return ret;
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::sendRequest(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    ResponseSink& response,
+    ReturnCode& status,
+    RequestOptions const& options,
+    std::chrono::seconds const& timeout
+)
+{
+    auto expire = Clock::now() + timeout;
+
+    if (options.deadline != Clock::time_point())
+    {
+        expire = std::min(expire, options.deadline);
+    }
+
+    if (m_retry.isEnabled())
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+        m_retry.onRequest();
+    }
+
+    return place(pairs, body, response, status, options, expire);
+}
+
+template<typename Protocol>
+void FastCgiClientPool<Protocol>::closeConnections()
+{
+    for (auto& backend : m_backends)
+    {
+        for (auto& conn : backend.connections)
+        {
+            conn.client->closeConnection();
+        }
+    }
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::dispatch(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    std::string& response,
+    ReturnCode& status,
+    RequestOptions const& options,
+    std::chrono::seconds const& timeout
+)
+{
+    auto expire = Clock::now() + timeout;
+
+    if (options.deadline != Clock::time_point())
+    {
+        expire = std::min(expire, options.deadline);
+    }
+
+    std::chrono::microseconds hedgeDelay(0);
+    bool hedge(false);
+
+    if (m_hedge.isEnabled() || m_retry.isEnabled())
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+
+        if (m_retry.isEnabled())
+        {
+            m_retry.onRequest();
+        }
+
+        if (m_hedge.isEnabled())
+        {
+            m_hedge.onRequest();
+            hedge = options.idempotent && m_hedge.delay(hedgeDelay);
+        }
+    }
+
+    if (hedge)
+    {
+        return sendHedged(
+            pairs, body, response, status, hedgeDelay, expire, options.priority
+        );
+    }
+
+    return place(pairs, body, response, status, options, expire);
+}
+
+template<typename Protocol>
+template<typename Response>
+bool FastCgiClientPool<Protocol>::place(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    Response& response,
+    ReturnCode& status,
+    RequestOptions const& options,
+    Clock::time_point expire
+)
+{
+    size_t backend;
+    size_t connection;
+    size_t avoid(NO_BACKEND);
+    bool ret(false);
+
+    for (size_t attempt = 0; ; ++attempt)
+    {
+        status = acquire(backend, connection, expire, options.priority, avoid);
+
+        if (status != ReturnCode::OK)
+        {
+            WARN("no connection available, code (=%d).", static_cast<int>(status));
+            return false;
+        }
+
+        std::chrono::microseconds latency;
+        ret = execute(
+            backend, connection, pairs, body, response, status, expire, latency
+        );
+        release(backend, connection, status, latency);
+
+        // once response bytes arrived the server has run the request,
+        // sending it again would not be transparent
+        const bool broken = (status == ReturnCode::CLOSED) || (status == ReturnCode::IO_ERROR);
+
+        if (ret || !broken || !options.idempotent || (response.size() > 0)
+            || (attempt >= m_retry.maxRetries()) || (Clock::now() >= expire))
+        {
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_sync);
+
+            if (!m_retry.isEnabled() || !m_retry.tryAcquire())
+            {
+                WARN("retry budget exhausted, code (=%d).", static_cast<int>(status));
+                break;
+            }
+        }
+
+        INFO("retry request on a fresh connection, code (=%d).", static_cast<int>(status));
+        response.clear();
+        avoid = backend;
+    }
+
+    return ret;
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::select(
+    size_t& backend,
+    size_t& connection,
+    Clock::time_point now,
+    size_t avoid
+)
+{
+    bool found(false);
+    double bestScore(0.0);
+
+    // weighted least-request, rotating the start to break ties
+    for (size_t n = 0; n < m_backends.size(); ++n)
+    {
+        const auto idx = (m_next + n) % m_backends.size();
+        const auto weight = m_detector.weight(idx, now);
+
+        if ((idx == avoid) || (weight <= 0.0))
+        {
+            continue;
+        }
+
+        if (m_backends[idx].inflight >= m_backends[idx].limiter.limit())
+        {
+            continue;
+        }
+
+        auto const& conns = m_backends[idx].connections;
+        auto freeConn = std::find_if(conns.begin(), conns.end(), [] (auto const& conn) {
+            return !conn.busy;
+        });
+
+        if (freeConn == conns.end())
+        {
+            continue;
+        }
+
+        const auto score = (m_backends[idx].inflight + 1) / weight;
+
+        if (!found || (score < bestScore))
+        {
+            found = true;
+            bestScore = score;
+            backend = idx;
+            connection = std::distance(conns.begin(), freeConn);
+        }
+    }
+
+    if (!found && (avoid != NO_BACKEND))
+    {
+        // fall back to another connection of the avoided server
+        return select(backend, connection, now, NO_BACKEND);
+    }
+
+    return found;
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::coalesce(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    std::shared_ptr<const std::string>& response,
+    ReturnCode& status,
+    RequestOptions const& options,
+    std::chrono::seconds const& timeout
+)
+{
+    const auto key = fingerprint(pairs, body);
+    auto expire = Clock::now() + timeout;
+    RequestOptions own(options);
+
+    if (options.deadline != Clock::time_point())
+    {
+        expire = std::min(expire, options.deadline);
+    }
+
+    for (;;)
+    {
+        std::shared_ptr<Flight> flight;
+        bool leader(false);
+
+        {
+            std::unique_lock<std::mutex> lock(m_sync);
+            auto range = m_flights.equal_range(key);
+
+            // a fingerprint match is confirmed, collisions must not share responses
+            auto joined = std::find_if(range.first, range.second, [&] (auto const& entry) {
+                return (*entry.second->pairs == pairs) && (*entry.second->body == body);
+            });
+
+            if (joined == range.second)
+            {
+                flight = std::make_shared<Flight>();
+                flight->pairs = &pairs;
+                flight->body = &body;
+                m_flights.emplace(key, flight);
+                leader = true;
+            }
+            else
+            {
+                flight = joined->second;
+
+                if (!m_landed.wait_until(lock, expire, [&flight] () { return flight->landed; }))
+                {
+                    WARN("coalesced request time out.");
+                    status = ReturnCode::TIMEOUT;
+                    return false;
+                }
+            }
+        }
+
+        if (leader)
+        {
+            auto response = std::make_shared<std::string>();
+            ReturnCode rc;
+            const auto ok = dispatch(pairs, body, *response, rc, own, timeout);
+
+            {
+                std::lock_guard<std::mutex> lock(m_sync);
+                flight->response = std::move(response);
+                flight->status = rc;
+                flight->ok = ok;
+                flight->landed = true;
+
+                // pairs and body go out of scope with this call
+                auto range = m_flights.equal_range(key);
+                for (auto it = range.first; it != range.second; ++it)
+                {
+                    if (it->second == flight)
+                    {
+                        m_flights.erase(it);
+                        break;
+                    }
+                }
+            }
+
+            m_landed.notify_all();
+        }
+
+        // a leader rejected or timed out by its own deadline or priority
+        // says nothing about a follower that still has time left
+        const bool leadersFailure = !leader
+            && ((flight->status == ReturnCode::REJECTED) || (flight->status == ReturnCode::TIMEOUT));
+
+        if (!leadersFailure || (Clock::now() >= expire))
+        {
+            response = flight->response;
+            status = flight->status;
+            return flight->ok;
+        }
+
+        DEBUG("coalesced leader failed, code (=%d), dispatch again.", static_cast<int>(flight->status));
+
+        // a new dispatch keeps to this caller's own deadline
+        own.deadline = expire;
+    }
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::roundTrip(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    std::shared_ptr<const std::string>& response,
+    ReturnCode& status,
+    RequestOptions const& options,
+    std::chrono::seconds const& timeout
+)
+{
+    if (m_coalesce)
+    {
+        return coalesce(pairs, body, response, status, options, timeout);
+    }
+
+    auto own = std::make_shared<std::string>();
+    const auto ret = dispatch(pairs, body, *own, status, options, timeout);
+    response = std::move(own);
+    return ret;
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::fetch(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    std::shared_ptr<const std::string>& response,
+    ReturnCode& status,
+    RequestOptions const& options,
+    std::chrono::seconds const& timeout
+)
+{
+    std::string key;
+
+    if (!m_cache.isEnabled() || !body.empty() || !m_cache.key(pairs, key))
+    {
+        return roundTrip(pairs, body, response, status, options, timeout);
+    }
+
+    switch (m_cache.lookup(key, response))
+    {
+        case ResponseCache::Freshness::STALE:
+            if (m_cache.beginRefresh(key))
+            {
+                refresh(pairs, key, options, timeout);
+            }
+            status = ReturnCode::OK;
+            return true;
+
+        case ResponseCache::Freshness::FRESH:
+            status = ReturnCode::OK;
+            return true;
+
+        default:
+            break;
+    }
+
+    const auto ret = roundTrip(pairs, body, response, status, options, timeout);
+
+    if (ret)
+    {
+        m_cache.store(key, response);
+    }
+
+    return ret;
+}
+
+template<typename Protocol>
+void FastCgiClientPool<Protocol>::refresh(
+    KeyValuePairs const& pairs,
+    std::string const& key,
+    RequestOptions const& options,
+    std::chrono::seconds const& timeout
+)
+{
+    track(std::async(std::launch::async, [this, pairs, key, options, timeout] () {
+        const std::string body;
+        std::shared_ptr<const std::string> response;
+        ReturnCode status;
+
+        if (roundTrip(pairs, body, response, status, options, timeout))
+        {
+            m_cache.store(key, response);
+        }
+        else
+        {
+            m_cache.abandonRefresh(key);
+        }
+    }));
+}
+
+template<typename Protocol>
+void FastCgiClientPool<Protocol>::track(std::future<void>&& task)
+{
+    std::lock_guard<std::mutex> lock(m_sync);
+
+    m_background.remove_if([] (std::future<void> const& pending) {
+        return pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    });
+    m_background.push_back(std::move(task));
+}
+
+template<typename Protocol>
+size_t FastCgiClientPool<Protocol>::capacity(Clock::time_point now) const
+{
+    size_t slots(0);
+
+    for (size_t i = 0; i < m_backends.size(); ++i)
+    {
+        if (m_detector.weight(i, now) > 0.0)
+        {
+            slots += std::min(m_backends[i].connections.size(), m_backends[i].limiter.limit());
+        }
+    }
+
+    return slots;
+}
+
+template<typename Protocol>
+ReturnCode FastCgiClientPool<Protocol>::acquire(
+    size_t& backend,
+    size_t& connection,
+    Clock::time_point expire,
+    int priority,
+    size_t avoid
+)
+{
+    std::unique_lock<std::mutex> lock(m_sync);
+    auto now = Clock::now();
+
+    // nobody overtakes requests that are already waiting
+    auto found = m_queue.isEmpty() && select(backend, connection, now, avoid);
+
+    if (!found)
+    {
+        if (now >= expire)
+        {
+            return ReturnCode::TIMEOUT;
+        }
+
+        if (m_queue.isFull())
+        {
+            // fail fast instead of piling up behind saturated servers
+            return ReturnCode::REJECTED;
+        }
+
+        if (now + m_queue.predict(expire, priority, capacity(now)) > expire)
+        {
+            // would time out anyway, do not spend server capacity on it
+            DEBUG("reject request, predicted to miss its deadline.");
+            return ReturnCode::REJECTED;
+        }
+
+        const auto ticket = m_queue.push(expire, priority);
+
+        while (!found)
+        {
+            const auto waited = m_released.wait_until(lock, expire);
+            found = m_queue.isHead(ticket) && select(backend, connection, Clock::now(), avoid);
+
+            if (waited == std::cv_status::timeout)
+            {
+                break;
+            }
+        }
+
+        m_queue.remove(ticket);
+
+        // let the next waiter check for another free connection
+        m_released.notify_all();
+    }
+
+    if (!found)
+    {
+        return ReturnCode::TIMEOUT;
+    }
+
+    m_next = (backend + 1) % m_backends.size();
+    m_backends[backend].connections[connection].busy = true;
+    ++m_backends[backend].inflight;
+    return ReturnCode::OK;
+}
+
+template<typename Protocol>
+template<typename Response>
+bool FastCgiClientPool<Protocol>::execute(
+    size_t backend,
+    size_t connection,
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    Response& response,
+    ReturnCode& status,
+    Clock::time_point expire,
+    std::chrono::microseconds& latency
+)
+{
+    // the busy flag gives this thread exclusive use of the connection
+    auto& client = *m_backends[backend].connections[connection].client;
+    const auto start = Clock::now();
+    const auto remaining = std::max(
+        std::chrono::duration_cast<std::chrono::seconds>(expire - start),
+        std::chrono::seconds(1)
+    );
+    bool ret(false);
+
+    if (!client.isOpen() && !client.openConnection())
+    {
+        status = ReturnCode::CLOSED;
+    }
+    else
+    {
+        ret = client.sendRequest(pairs, body, response, status, remaining);
+    }
+
+    if ((status == ReturnCode::CLOSED) || (status == ReturnCode::IO_ERROR))
+    {
+        // reopened lazily by the next request picking this connection
+        client.closeConnection();
+    }
+
+    latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    return ret;
+}
+
+template<typename Protocol>
+void FastCgiClientPool<Protocol>::release(
+    size_t backend,
+    size_t connection,
+    ReturnCode rc,
+    std::chrono::microseconds latency,
+    bool sample
+)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+        auto& server = m_backends[backend];
+
+        if (sample)
+        {
+            // the server answered, the response only outgrew the caller limit
+            rc = (rc == ReturnCode::TOO_LARGE) ? ReturnCode::OK : rc;
+            server.limiter.record(rc, latency, server.inflight);
+            m_detector.record(backend, rc, latency);
+            m_queue.recordService(latency);
+
+            if (rc == ReturnCode::OK)
+            {
+                m_hedge.record(latency);
+            }
+        }
+
+        server.connections[connection].busy = false;
+        --server.inflight;
+    }
+
+    m_released.notify_all();
+}
+
+template<typename Protocol>
+void FastCgiClientPool<Protocol>::checkHealth()
+{
+    std::unique_lock<std::mutex> lock(m_sync);
+    size_t round = 0;
+
+    while (!m_stop.wait_for(lock, m_health.interval, [this] () { return m_stopping; }))
+    {
+        const bool ping = (m_health.pingEvery > 0) && ((++round % m_health.pingEvery) == 0);
+
+        for (auto& backend : m_backends)
+        {
+            for (auto& conn : backend.connections)
+            {
+                if (conn.busy || m_stopping)
+                {
+                    continue;
+                }
+
+                // busy keeps requests off the connection while it is checked
+                conn.busy = true;
+                lock.unlock();
+
+                if (!conn.client->probe(ping, m_health.pingTimeout))
+                {
+                    WARN("reconnect after stale connection failed.");
+                }
+
+                lock.lock();
+                conn.busy = false;
+                m_released.notify_all();
+            }
+        }
+    }
+}
+
+template<typename Protocol>
+bool FastCgiClientPool<Protocol>::sendHedged(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    std::string& response,
+    ReturnCode& status,
+    std::chrono::microseconds delay,
+    Clock::time_point expire,
+    int priority
+)
+{
+    size_t backend;
+    size_t connection;
+    status = acquire(backend, connection, expire, priority);
+
+    if (status != ReturnCode::OK)
+    {
+        WARN("no connection available, code (=%d).", static_cast<int>(status));
+        return false;
+    }
+
+    // both copies run on workers, the loser may outlive this call
+    auto call = std::make_shared<HedgedCall>();
+    call->pairs = pairs;
+    call->body = body;
+    call->expire = expire;
+    call->priority = priority;
+    call->backend = backend;
+    call->started[0] = true;
+    call->client[0] = m_backends[backend].connections[connection].client.get();
+
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+        const auto due = m_hedges.emplace(Clock::now() + delay, call);
+
+        spareWorker();
+
+        if (due == m_hedges.begin())
+        {
+            m_work.notify_all();
+        }
+    }
+
+    submit([this, call, backend, connection] () {
+        run(call, 0, backend, connection);
+    });
+
+    std::unique_lock<std::mutex> lock(call->sync);
+
+    call->settled.wait(lock, [&call] () {
+        return (call->winner >= 0) || (call->done[0] && (!call->started[1] || call->done[1]));
+    });
+
+    if (call->winner < 0)
+    {
+        response = call->response[0];
+        status = call->status[0];
+        return false;
+    }
+
+    response = call->response[call->winner];
+    status = call->status[call->winner];
+    return true;
+}
+
+template<typename Protocol>
+void FastCgiClientPool<Protocol>::submit(std::function<void()>&& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+        m_tasks.push_back(std::move(task));
+        spareWorker();
+    }
+
+    m_work.notify_one();
+}
+
+template<typename Protocol>
+void FastCgiClientPool<Protocol>::spareWorker()
+{
+    const size_t needed = m_tasks.size() + (m_hedges.empty() ? 0 : 1);
+
+    if (m_idleWorkers < needed)
+    {
+        // counted idle from the start, so a burst starts no more than needed
+        ++m_idleWorkers;
+        m_workers.emplace_back(&FastCgiClientPool::work, this);
+    }
+}
+
+template<typename Protocol>
+void FastCgiClientPool<Protocol>::work()
+{
+    std::unique_lock<std::mutex> lock(m_sync);
+
+    while (!m_stopping || !m_tasks.empty())
+    {
+        const auto now = Clock::now();
+
+        if (!m_tasks.empty())
+        {
+            auto task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+
+            --m_idleWorkers;
+            spareWorker();
+            lock.unlock();
+            task();
+            lock.lock();
+            ++m_idleWorkers;
+        }
+        else if (!m_stopping && !m_hedges.empty() && (m_hedges.begin()->first <= now))
+        {
+            auto call = m_hedges.begin()->second;
+            m_hedges.erase(m_hedges.begin());
+
+            --m_idleWorkers;
+            spareWorker();
+            lock.unlock();
+            hedge(call);
+            lock.lock();
+            ++m_idleWorkers;
+        }
+        else if (m_stopping)
+        {
+            break;
+        }
+        else if (m_hedges.empty())
+        {
+            m_work.wait(lock);
+        }
+        else
+        {
+            m_work.wait_until(lock, m_hedges.begin()->first);
+        }
+    }
+
+    --m_idleWorkers;
+}
+
+template<typename Protocol>
+void FastCgiClientPool<Protocol>::hedge(std::shared_ptr<HedgedCall> const& call)
+{
+    {
+        std::lock_guard<std::mutex> lock(call->sync);
+
+        if (call->done[0])
+        {
+            return;
+        }
+    }
+
+    bool hedged(false);
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+        hedged = m_hedge.tryAcquire();
+    }
+
+    size_t backend;
+    size_t connection;
+
+    if (!hedged || (acquire(backend, connection, Clock::now(), call->priority, call->backend) != ReturnCode::OK))
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(call->sync);
+
+        // the original may have ended while a connection was found
+        if (!call->done[0])
+        {
+            call->started[1] = true;
+            call->client[1] = m_backends[backend].connections[connection].client.get();
+        }
+    }
+
+    if (!call->started[1])
+    {
+        release(backend, connection, ReturnCode::OK, std::chrono::microseconds(0), false);
+        return;
+    }
+
+    DEBUG("hedge request of backend (=%zu) on backend (=%zu).", call->backend, backend);
+    run(call, 1, backend, connection);
+}
+
+template<typename Protocol>
+void FastCgiClientPool<Protocol>::run(
+    std::shared_ptr<HedgedCall> const& call,
+    int slot,
+    size_t backend,
+    size_t connection
+)
+{
+    std::string response;
+    ReturnCode status;
+    std::chrono::microseconds latency;
+    const auto ret = execute(
+        backend, connection, call->pairs, call->body, response, status, call->expire, latency
+    );
+    bool aborted(false);
+
+    {
+        // settle before release, so an abort never hits a reused connection
+        std::lock_guard<std::mutex> lock(call->sync);
+        call->done[slot] = true;
+        call->status[slot] = status;
+        call->response[slot] = std::move(response);
+        call->client[slot] = nullptr;
+        aborted = call->aborted[slot];
+
+        if (ret && (call->winner < 0))
+        {
+            const auto loser = 1 - slot;
+            call->winner = slot;
+
+            if (call->started[loser] && !call->done[loser])
+            {
+                // connection stays busy until the server ends the aborted request
+                call->aborted[loser] = true;
+                call->client[loser]->abortRequest();
+            }
+        }
+    }
+
+    call->settled.notify_all();
+
+    // an aborted request says nothing about the server's latency
+    release(backend, connection, status, latency, !aborted);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_FCGICODEC_H_
+#define INC_FCGICODEC_H_
+
+#include <cstdint>
+#include <string>
+
+#include "Common.h"
+
+static const int FCGI_VERSION = 1;
+static const int FCGI_HEADER_SIZE = 8;
+static const size_t FCGI_MAX_CONTENT = 0xFFFF;
+
+static const std::string VER_TOKEN("version");
+static const std::string TYPE_TOKEN("type");
+static const std::string REQ_ID_TOKEN("requestId");
+static const std::string CONT_LEN_TOKEN("contentLength");
+static const std::string PADDING_LEN_TOKEN("paddingLength");
+
+/**
+ * @brief encode body of FCGI_BEGIN_REQUEST, keeping the connection open
+ */
+std::string encodeBeginRequest(uint8_t role);
+
+/**
+ * @brief encode a single record, content must fit in one record
+ */
+std::string encodeFastCgiRecord(
+    uint8_t recType,
+    std::string const& content,
+    uint16_t requestId
+);
+
+/**
+ * @brief encode content as records of at most FCGI_MAX_CONTENT bytes
+ */
+std::string encodeFastCgiStream(
+    uint8_t recType,
+    std::string const& content,
+    uint16_t requestId
+);
+
+/**
+ * @brief write the FCGI_HEADER_SIZE bytes of a record header to hdr
+ */
+void encodeFastCgiHeader(
+    char* hdr,
+    uint8_t recType,
+    uint16_t requestId,
+    size_t contentLen
+);
+
+/**
+ * @brief encode a name-value pair of FCGI_PARAMS, empty if name is empty
+ */
+std::string encodeNameValueParams(
+    std::string const& name,
+    std::string const& value
+);
+
+/**
+ * @brief decode a record header into its fields, keyed by the tokens
+ */
+bool decodeFastCgiHeader(std::string const& buf, NameTagPairs& pairs);
+
+#endif /* INC_FCGICODEC_H_ */
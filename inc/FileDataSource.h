@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_FILEDATASOURCE_H_
+#define INC_FILEDATASOURCE_H_
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+
+#include <sys/types.h>
+
+/*
+ * reads a region of a file in bounded windows. Regular files are
+ * memory mapped one window at a time, other descriptors such as pipes
+ * are read into a buffer of the window size.
+ *
+ * no thread-safe class
+ */
+class FileDataSource final
+{
+public:
+
+    static const size_t DEFAULT_WINDOW;
+
+    /**
+     * Constructor
+     *
+     * @param fd file descriptor, still owned by the caller
+     * @param offset start of the region, ignored for non-regular files
+     * @param length bytes to read, until end of file if zero
+     * @param window upper bound of memory mapped or buffered at once
+     */
+    FileDataSource(
+        int fd,
+        off_t offset = 0,
+        size_t length = 0,
+        size_t window = DEFAULT_WINDOW
+    );
+
+    ~FileDataSource();
+
+    /**
+     * @brief test if the descriptor could be inspected
+     */
+    bool isValid() const;
+
+    /**
+     * @brief size of the region if known up front
+     *
+     * @return false for pipes and other streams without a size
+     */
+    bool length(size_t& len) const;
+
+    /**
+     * @brief modification time of the file
+     */
+    time_t lastModified() const;
+
+    /**
+     * @brief advance to the next window of data
+     *
+     * The previous window becomes invalid.
+     *
+     * @param data receives start of the window
+     * @param len receives window size, zero at end of data
+     *
+     * @return false on read or map error, or if a stream of known
+     * length ends early
+     */
+    bool next(const char*& data, size_t& len);
+
+private:
+
+    FileDataSource(FileDataSource const&) = delete;
+    FileDataSource& operator=(FileDataSource const&) = delete;
+
+    void unmap();
+
+    int m_fd;
+    bool m_valid = false;
+    bool m_mappable = false;
+    bool m_sized = false;
+    off_t m_offset;
+    size_t m_remaining = 0;
+    size_t m_window;
+    time_t m_lastModified = 0;
+    void* m_map = nullptr;
+    size_t m_mapLen = 0;
+    std::unique_ptr<char[]> m_buffer;
+};
+
+#endif /* INC_FILEDATASOURCE_H_ */
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_FILEREGION_H_
+#define INC_FILEREGION_H_
+
+#include <chrono>
+#include <cstdint>
+
+#include <sys/types.h>
+
+#include "Common.h"
+
+/*
+ * request body taken from a file descriptor instead of memory
+ */
+struct FileRegion
+{
+    // regular file or pipe, still owned by the caller
+    int fd = -1;
+
+    // start of the body, ignored for pipes
+    off_t offset = 0;
+
+    // body length, until end of file or pipe if zero
+    size_t length = 0;
+
+    /**
+     * @brief test if fd refers to a regular file
+     *
+     * @param size receives the file size
+     */
+    bool isRegularFile(size_t& size) const;
+
+    /**
+     * @brief wait until a pipe has data or reached its end
+     *
+     * @param available receives bytes ready to read, zero at end
+     * @param expire give up waiting at this time
+     *
+     * @return OK if data or the end arrived, TIMEOUT if expire passed
+     * first, IO_ERROR otherwise
+     */
+    ReturnCode waitReadable(
+        size_t& available,
+        std::chrono::steady_clock::time_point expire
+    ) const;
+};
+
+#endif /* INC_FILEREGION_H_ */
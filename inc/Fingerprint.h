@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_FINGERPRINT_H_
+#define INC_FINGERPRINT_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+
+/**
+ * @brief 64-bit FNV-1a hash of request params and body
+ *
+ * Names and values are hashed with their lengths, the same way they
+ * are laid out by the name-value encoding, so {"ab", "c"} and
+ * {"a", "bc"} differ.
+ *
+ * @param pairs request params
+ * @param body request body
+ *
+ * @return fingerprint of the request
+ */
+uint64_t fingerprint(KeyValuePairs const& pairs, std::string const& body);
+
+/**
+ * @brief 64-bit FNV-1a hash of a plain string
+ */
+uint64_t fingerprint(std::string const& str);
+
+/**
+ * @brief cache key made of the values of the named params
+ *
+ * Values are length prefixed, so they cannot run into each other, and
+ * a missing param is marked as such.
+ *
+ * @param pairs request params
+ * @param names params making up the key, in key order
+ * @param key receives the key
+ *
+ * @return true if at least one of the named params is present
+ */
+bool paramsKey(
+    KeyValuePairs const& pairs,
+    std::vector<std::string> const& names,
+    std::string& key
+);
+
+#endif /* INC_FINGERPRINT_H_ */
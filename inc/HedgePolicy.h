@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_HEDGEPOLICY_H_
+#define INC_HEDGEPOLICY_H_
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/*
+ * when and how often idempotent requests are hedged
+ */
+struct HedgeConfig
+{
+    // hedging is opt-in
+    bool enabled = false;
+
+    // hedge once a request is slower than this percentile of recent ones
+    double percentile = 95.0;
+
+    // hedges allowed as a percentage of all requests
+    double budgetPercent = 5.0;
+
+    // never hedge earlier than this
+    std::chrono::milliseconds minDelay{ 5 };
+
+    // number of recent latencies the percentile is taken from
+    size_t window = 512;
+};
+
+/*
+ * derives the hedge delay from recent latencies and limits hedges
+ * with a token bucket refilled by every request.
+ *
+ * no thread-safe class
+ */
+class HedgePolicy final
+{
+public:
+
+    /**
+     * Constructor
+     *
+     * @param config hedge percentile and budget
+     */
+    explicit HedgePolicy(HedgeConfig const& config = HedgeConfig());
+
+    /**
+     * @brief test if hedging is enabled
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief record latency of a completed request
+     */
+    void record(std::chrono::microseconds latency);
+
+    /**
+     * @brief account a new request, earning a share of a hedge
+     */
+    void onRequest();
+
+    /**
+     * @brief delay after which a still running request is hedged
+     *
+     * @param delay receives the delay
+     *
+     * @return false until enough latencies were recorded
+     */
+    bool delay(std::chrono::microseconds& delay);
+
+    /**
+     * @brief take one hedge from the budget
+     *
+     * @return false if the budget is exhausted
+     */
+    bool tryAcquire();
+
+private:
+
+    HedgeConfig m_config;
+    std::vector<int64_t> m_samples;
+    size_t m_next = 0;
+    size_t m_sinceUpdate = 0;
+    std::chrono::microseconds m_delay{ 0 };
+    double m_tokens = 0.0;
+};
+
+#endif /* INC_HEDGEPOLICY_H_ */
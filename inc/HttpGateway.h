@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_HTTPGATEWAY_H_
+#define INC_HTTPGATEWAY_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asio.hpp"
+
+#include "FastCGIClient.h"
+#include "HttpMessage.h"
+#include "TransportProfile.h"
+
+/*
+ * gateway settings
+ */
+struct GatewayConfig
+{
+    // executor threads, which bound the requests in flight
+    size_t threads = 4;
+
+    // size limit of a request head
+    size_t maxHeaderBytes = 64 * 1024;
+
+    // keep-alive connections idle longer are closed
+    std::chrono::seconds idleTimeout{ 60 };
+
+    // limit of one fcgi exchange
+    std::chrono::seconds requestTimeout{ 60 };
+
+    std::string documentRoot = "/var/www/html";
+
+    // script for every request, a front controller such as index.php;
+    // document root plus path if empty
+    std::string scriptFilename;
+
+    std::string serverSoftware = "fcgi-client";
+
+    // socket options of the fcgi connections
+    TransportProfile transport;
+};
+
+/*
+ * HTTP/1.1 to fcgi gateway. Accepts keep-alive connections on a
+ * multi-threaded executor, maps requests to cgi params and streams
+ * bodies both ways: request bodies are spliced from the client socket
+ * into the fcgi connection through a pipe, responses are written to the
+ * client as their records arrive, chunked unless the script sets a
+ * Content-Length. Chunked request bodies are answered with 411.
+ *
+ * A request holds its executor thread until it completes, with one fcgi
+ * connection per thread; idle keep-alive connections hold no thread.
+ *
+ * thread-safe class
+ */
+template<typename Protocol>
+class HttpGateway final
+{
+public:
+
+    /**
+     * Constructor
+     *
+     * @param listen address to accept HTTP connections on
+     * @param upstream fcgi server
+     */
+    HttpGateway(
+        asio::ip::tcp::endpoint const& listen,
+        typename Protocol::endpoint const& upstream,
+        GatewayConfig const& config = GatewayConfig()
+    );
+
+    ~HttpGateway();
+
+    /**
+     * @brief bind the listen address and start the executor threads
+     */
+    bool start();
+
+    /**
+     * @brief stop accepting, close connections and join the threads
+     */
+    void stop();
+
+    /**
+     * @brief bound port, useful when listening on port 0
+     */
+    unsigned short port() const;
+
+private:
+
+    // one HTTP connection, its handlers run on its strand
+    struct Session
+    {
+        Session(asio::io_context& ioCtx, size_t maxHeaderBytes)
+            : strand(ioCtx.get_executor())
+            , socket(ioCtx)
+            , timer(ioCtx)
+            , buffer(maxHeaderBytes)
+        {
+        }
+
+        asio::strand<asio::io_context::executor_type> strand;
+        asio::ip::tcp::socket socket;
+        asio::steady_timer timer;
+        asio::streambuf buffer;
+        CgiContext context;
+    };
+
+    // response of one request as it streams to the client
+    struct ResponseState
+    {
+        std::string head;
+        bool headSent = false;
+        bool chunked = false;
+        bool keepAlive = true;
+        bool bodiless = false;
+        bool writeFailed = false;
+    };
+
+    HttpGateway(HttpGateway const&) = delete;
+    HttpGateway& operator=(HttpGateway const&) = delete;
+
+    void accept();
+
+    void readHead(std::shared_ptr<Session> const& session);
+
+    void handle(std::shared_ptr<Session> const& session, size_t headLen);
+
+    bool forward(
+        Session& session,
+        HttpRequestHead const& request,
+        ResponseState& state
+    );
+
+    bool stream(
+        Session& session,
+        HttpRequestHead const& request,
+        ResponseState& state,
+        const char* data,
+        size_t len
+    );
+
+    bool writeBody(Session& session, ResponseState& state, const char* data, size_t len);
+
+    bool writeAll(Session& session, std::string const& data);
+
+    /**
+     * @brief write buffers to the client within the request timeout
+     *
+     * @return false if the client failed or stopped reading in time
+     */
+    bool send(Session& session, std::vector<asio::const_buffer> const& buffers);
+
+    static void close(Session& session);
+
+    static bool pumpBody(
+        int sock,
+        int pipeFd,
+        std::string const& buffered,
+        size_t remaining,
+        std::chrono::seconds const& idleLimit
+    );
+
+    FastCgiClient<Protocol>* checkout();
+
+    void checkin(FastCgiClient<Protocol>* client);
+
+    GatewayConfig m_config;
+    typename Protocol::endpoint m_upstream;
+    asio::ip::tcp::endpoint m_listen;
+    asio::io_context m_ioCtx;
+    asio::ip::tcp::acceptor m_acceptor;
+    std::vector<std::thread> m_threads;
+    std::atomic<bool> m_stopped{ true };
+
+    std::mutex m_sync;
+    std::condition_variable m_released;
+    std::vector<std::unique_ptr<FastCgiClient<Protocol>>> m_clients;
+    std::vector<FastCgiClient<Protocol>*> m_idle;
+};
+
+#include "HttpGatewayImpl.h"
+
+#endif /* INC_HTTPGATEWAY_H_ */
@@ -0,0 +1,709 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "HttpGateway.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "CgiHeaders.h"
+#include "ILogger.h"
+
+static const std::string HEAD_END("\r\n\r\n");
+static const std::string CONTINUE_RESPONSE("HTTP/1.1 100 Continue\r\n\r\n");
+static const std::string CHUNK_END("\r\n");
+static const std::string LAST_CHUNK("0\r\n\r\n");
+static const int PUMP_POLL_MS = 100;
+
+template<typename Protocol>
+HttpGateway<Protocol>::HttpGateway(
+    asio::ip::tcp::endpoint const& listen,
+    typename Protocol::endpoint const& upstream,
+    GatewayConfig const& config
+)
+    : m_config(config)
+    , m_upstream(upstream)
+    , m_listen(listen)
+    , m_acceptor(m_ioCtx)
+{
+    m_config.threads = std::max<size_t>(m_config.threads, 1);
+
+    for (size_t i = 0; i < m_config.threads; ++i)
+    {
+        m_clients.emplace_back(new FastCgiClient<Protocol>(upstream, m_config.transport));
+        m_idle.push_back(m_clients.back().get());
+    }
+}
+
+template<typename Protocol>
+HttpGateway<Protocol>::~HttpGateway()
+{
+    stop();
+}
+
+template<typename Protocol>
+bool HttpGateway<Protocol>::start()
+{
+    asio::error_code ec;
+
+    m_acceptor.open(m_listen.protocol(), ec);
+
+    if (!ec)
+    {
+        m_acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true), ec);
+    }
+
+    if (!ec)
+    {
+        m_acceptor.bind(m_listen, ec);
+    }
+
+    if (!ec)
+    {
+        m_acceptor.listen(asio::socket_base::max_listen_connections, ec);
+    }
+
+    if (ec)
+    {
+        WARN("gateway listen failed, error (=%s).", ec.message().c_str());
+        m_acceptor.close(ec);
+        return false;
+    }
+
+    m_stopped = false;
+    accept();
+
+    for (size_t i = 0; i < m_config.threads; ++i)
+    {
+        m_threads.emplace_back([this] {
+            m_ioCtx.run();
+        });
+    }
+
+    INFO("gateway listening on port (=%u) with (=%zu) threads.", port(), m_config.threads);
+    return true;
+}
+
+template<typename Protocol>
+void HttpGateway<Protocol>::stop()
+{
+    if (m_stopped.exchange(true))
+    {
+        return;
+    }
+
+    asio::post(m_ioCtx, [this] {
+        asio::error_code ec;
+        m_acceptor.close(ec);
+    });
+
+    // requests in flight complete first, idle connections are dropped
+    m_ioCtx.stop();
+
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+
+    m_threads.clear();
+}
+
+template<typename Protocol>
+unsigned short HttpGateway<Protocol>::port() const
+{
+    asio::error_code ec;
+    return m_acceptor.local_endpoint(ec).port();
+}
+
+template<typename Protocol>
+void HttpGateway<Protocol>::accept()
+{
+    auto session = std::make_shared<Session>(m_ioCtx, m_config.maxHeaderBytes);
+
+    m_acceptor.async_accept(session->socket, [this, session] (asio::error_code const& ec) {
+        if ((ec == asio::error::operation_aborted) || m_stopped)
+        {
+            return;
+        }
+
+        if (ec)
+        {
+            WARN("gateway accept failed, error (=%s).", ec.message().c_str());
+        }
+        else
+        {
+            asio::error_code ignored;
+            const auto remote = session->socket.remote_endpoint(ignored);
+            const auto local = session->socket.local_endpoint(ignored);
+
+            session->socket.set_option(asio::ip::tcp::no_delay(true), ignored);
+            session->context.documentRoot = m_config.documentRoot;
+            session->context.scriptFilename = m_config.scriptFilename;
+            session->context.serverSoftware = m_config.serverSoftware;
+            session->context.remoteAddr = remote.address().to_string();
+            session->context.remotePort = std::to_string(remote.port());
+            session->context.serverAddr = local.address().to_string();
+            session->context.serverPort = std::to_string(local.port());
+
+            asio::post(session->strand, [this, session] {
+                readHead(session);
+            });
+        }
+
+        accept();
+    });
+}
+
+template<typename Protocol>
+void HttpGateway<Protocol>::readHead(std::shared_ptr<Session> const& session)
+{
+    session->timer.expires_after(m_config.idleTimeout);
+    session->timer.async_wait(asio::bind_executor(session->strand, [session] (asio::error_code const& ec) {
+        // a read completing at expiry has already rearmed the timer
+        if (!ec && (session->timer.expiry() <= std::chrono::steady_clock::now()))
+        {
+            close(*session);
+        }
+    }));
+
+    asio::async_read_until(
+        session->socket,
+        session->buffer,
+        HEAD_END,
+        asio::bind_executor(session->strand, [this, session] (asio::error_code const& ec, size_t headLen) {
+            session->timer.cancel();
+
+            if (ec == asio::error::not_found)
+            {
+                writeAll(*session, httpErrorResponse(431, false));
+                close(*session);
+            }
+            else if (ec)
+            {
+                close(*session);
+            }
+            else
+            {
+                handle(session, headLen);
+            }
+        })
+    );
+}
+
+template<typename Protocol>
+void HttpGateway<Protocol>::handle(std::shared_ptr<Session> const& session, size_t headLen)
+{
+    const auto begin = asio::buffers_begin(session->buffer.data());
+    const std::string head(begin, begin + headLen);
+    HttpRequestHead request;
+
+    session->buffer.consume(headLen);
+
+    if (!parseHttpRequestHead(head, request))
+    {
+        writeAll(*session, httpErrorResponse(400, false));
+        close(*session);
+        return;
+    }
+
+    // cgi needs CONTENT_LENGTH up front, which a chunked body lacks
+    if (request.chunked)
+    {
+        writeAll(*session, httpErrorResponse(411, false));
+        close(*session);
+        return;
+    }
+
+    ResponseState state;
+    state.keepAlive = request.keepAlive;
+
+    if (forward(*session, request, state) && state.keepAlive && !m_stopped)
+    {
+        readHead(session);
+    }
+    else
+    {
+        close(*session);
+    }
+}
+
+template<typename Protocol>
+bool HttpGateway<Protocol>::forward(
+    Session& session,
+    HttpRequestHead const& request,
+    ResponseState& state
+)
+{
+    KeyValuePairs params;
+
+    if (!httpToCgiParams(request, session.context, params))
+    {
+        WARN("request path rejected (=%s).", request.target.c_str());
+        state.keepAlive = false;
+        writeAll(session, httpErrorResponse(400, false));
+        return false;
+    }
+
+    SinkConfig sinkConfig;
+
+    sinkConfig.consumer = [&, this] (const char* data, size_t len) {
+        return stream(session, request, state, data, len);
+    };
+
+    ResponseSink sink(sinkConfig);
+
+    if (request.expectContinue && (request.contentLength > 0) && !writeAll(session, CONTINUE_RESPONSE))
+    {
+        return false;
+    }
+
+    auto client = checkout();
+    ReturnCode status(ReturnCode::OK);
+    bool ok(false);
+    // set once the body has left the session, an unread body would be
+    // taken for the next request
+    bool bodyRead(false);
+
+    if (!client->isOpen() && !client->openConnection())
+    {
+        status = ReturnCode::CLOSED;
+    }
+    else if (request.contentLength <= session.buffer.size())
+    {
+        // small bodies arrive with the head
+        const auto begin = asio::buffers_begin(session.buffer.data());
+        const std::string body(begin, begin + request.contentLength);
+
+        session.buffer.consume(request.contentLength);
+        bodyRead = true;
+        ok = client->sendRequest(params, body, sink, status, m_config.requestTimeout);
+    }
+    else
+    {
+        int fds[2];
+
+        if (::pipe2(fds, O_CLOEXEC) != 0)
+        {
+            WARN("create body pipe failed, error (=%s).", std::strerror(errno));
+            status = ReturnCode::IO_ERROR;
+        }
+        else
+        {
+            const auto begin = asio::buffers_begin(session.buffer.data());
+            const std::string buffered(begin, begin + session.buffer.size());
+            const int sock = session.socket.native_handle();
+            const size_t remaining = request.contentLength - buffered.size();
+            const auto idleLimit = m_config.idleTimeout;
+
+            session.buffer.consume(buffered.size());
+
+            // the rest of the body moves from the client socket into the pipe
+            // while the client splices it on into the fcgi connection
+            std::thread pump([&, sock, remaining, idleLimit] {
+                bodyRead = pumpBody(sock, fds[1], buffered, remaining, idleLimit);
+                ::close(fds[1]);
+            });
+
+            FileRegion body;
+            body.fd = fds[0];
+            body.length = request.contentLength;
+
+            ok = client->sendRequest(params, body, sink, status, m_config.requestTimeout);
+
+            // a pump still writing fails on the closed pipe
+            ::close(fds[0]);
+            pump.join();
+        }
+    }
+
+    if (status != ReturnCode::OK)
+    {
+        // the fcgi stream may be out of step, reconnect on next use
+        client->closeConnection();
+    }
+
+    checkin(client);
+
+    state.keepAlive = state.keepAlive && bodyRead;
+
+    if (!state.headSent)
+    {
+        WARN("no valid response from fcgi server, status (=%d).", static_cast<int>(status));
+        state.keepAlive = state.keepAlive && !state.writeFailed;
+
+        const int code = (status == ReturnCode::TIMEOUT) ? 504 : 502;
+        return writeAll(session, httpErrorResponse(code, state.keepAlive));
+    }
+
+    if (!ok || state.writeFailed)
+    {
+        // the response is cut short, only closing tells the client
+        return false;
+    }
+
+    if (state.chunked && !state.bodiless && !writeAll(session, LAST_CHUNK))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+template<typename Protocol>
+bool HttpGateway<Protocol>::stream(
+    Session& session,
+    HttpRequestHead const& request,
+    ResponseState& state,
+    const char* data,
+    size_t len
+)
+{
+    if (state.headSent)
+    {
+        return writeBody(session, state, data, len);
+    }
+
+    state.head.append(data, len);
+
+    KeyValuePairs headers;
+    size_t bodyOffset;
+
+    if (!parseCgiHeaders(state.head, headers, bodyOffset))
+    {
+        return state.head.size() <= m_config.maxHeaderBytes;
+    }
+
+    const auto head = httpResponseHead(headers, request, state.chunked, state.keepAlive, state.bodiless);
+
+    state.headSent = true;
+
+    if (!writeAll(session, head))
+    {
+        state.writeFailed = true;
+        return false;
+    }
+
+    const std::string rest = state.head.substr(bodyOffset);
+
+    state.head.clear();
+    return writeBody(session, state, rest.data(), rest.size());
+}
+
+template<typename Protocol>
+bool HttpGateway<Protocol>::writeBody(
+    Session& session,
+    ResponseState& state,
+    const char* data,
+    size_t len
+)
+{
+    if (state.bodiless || (len == 0))
+    {
+        return true;
+    }
+
+    bool sent(false);
+
+    if (state.chunked)
+    {
+        char size[24];
+        const auto sizeLen = std::snprintf(size, sizeof(size), "%zx\r\n", len);
+
+        sent = send(session, {
+            asio::const_buffer(size, static_cast<size_t>(sizeLen)),
+            asio::const_buffer(data, len),
+            asio::const_buffer(CHUNK_END.data(), CHUNK_END.size()),
+        });
+    }
+    else
+    {
+        sent = send(session, { asio::const_buffer(data, len) });
+    }
+
+    if (!sent)
+    {
+        state.writeFailed = true;
+        return false;
+    }
+
+    return true;
+}
+
+template<typename Protocol>
+bool HttpGateway<Protocol>::writeAll(Session& session, std::string const& data)
+{
+    return send(session, { asio::buffer(data) });
+}
+
+template<typename Protocol>
+bool HttpGateway<Protocol>::send(Session& session, std::vector<asio::const_buffer> const& buffers)
+{
+    // a client that stops reading must not hold the executor thread and
+    // its fcgi connection, so the socket is never left blocking in write
+    const auto expire = std::chrono::steady_clock::now() + m_config.requestTimeout;
+    const int sock = session.socket.native_handle();
+    std::vector<struct iovec> iov;
+    size_t next(0);
+
+    for (auto const& buffer : buffers)
+    {
+        if (buffer.size() > 0)
+        {
+            iov.push_back({ const_cast<void*>(buffer.data()), buffer.size() });
+        }
+    }
+
+    while (next < iov.size())
+    {
+        struct msghdr msg = {};
+        msg.msg_iov = &iov[next];
+        msg.msg_iovlen = std::min<size_t>(iov.size() - next, IOV_MAX);
+
+        const auto sent = ::sendmsg(sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (sent >= 0)
+        {
+            auto done = static_cast<size_t>(sent);
+
+            while ((next < iov.size()) && (done >= iov[next].iov_len))
+            {
+                done -= iov[next].iov_len;
+                ++next;
+            }
+
+            if (done > 0)
+            {
+                iov[next].iov_base = static_cast<char*>(iov[next].iov_base) + done;
+                iov[next].iov_len -= done;
+            }
+            continue;
+        }
+
+        if (errno == EINTR)
+        {
+            continue;
+        }
+
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+        {
+            WARN("write response to client failed, error (=%s).", std::strerror(errno));
+            return false;
+        }
+
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            expire - std::chrono::steady_clock::now()
+        ).count();
+
+        if (left <= 0)
+        {
+            WARN(
+                "client read no response for (=%lld) seconds.",
+                static_cast<long long>(m_config.requestTimeout.count())
+            );
+            return false;
+        }
+
+        struct pollfd room = { sock, POLLOUT, 0 };
+
+        if ((::poll(&room, 1, static_cast<int>(std::min<long long>(left, INT_MAX))) < 0) && (errno != EINTR))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<typename Protocol>
+void HttpGateway<Protocol>::close(Session& session)
+{
+    asio::error_code ec;
+    session.timer.cancel();
+    session.socket.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+    session.socket.close(ec);
+}
+
+template<typename Protocol>
+bool HttpGateway<Protocol>::pumpBody(
+    int sock,
+    int pipeFd,
+    std::string const& buffered,
+    size_t remaining,
+    std::chrono::seconds const& idleLimit
+)
+{
+    // writing to a pipe without reader raises SIGPIPE in this thread
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    ::pthread_sigmask(SIG_BLOCK, &pipeSignal, nullptr);
+
+    size_t pos(0);
+
+    while (pos < buffered.size())
+    {
+        const auto put = ::write(pipeFd, buffered.data() + pos, buffered.size() - pos);
+
+        if (put > 0)
+        {
+            pos += static_cast<size_t>(put);
+        }
+        else if (errno != EINTR)
+        {
+            return false;
+        }
+    }
+
+    // only time spent waiting for the client counts, a full pipe waits on
+    // the fcgi side, which is bounded by the request timeout
+    std::chrono::steady_clock::duration idle(0);
+
+    while (remaining > 0)
+    {
+        // wait for room in the pipe first, then for data from the client,
+        // so neither side is polled while the other one holds the move up
+        struct pollfd room = { pipeFd, POLLOUT, 0 };
+
+        if ((::poll(&room, 1, PUMP_POLL_MS) < 0) && (errno != EINTR))
+        {
+            return false;
+        }
+
+        if ((room.revents & (POLLERR | POLLHUP)) != 0)
+        {
+            // the fcgi side stopped reading
+            return false;
+        }
+
+        if ((room.revents & POLLOUT) == 0)
+        {
+            continue;
+        }
+
+        struct pollfd data = { sock, POLLIN, 0 };
+        const auto polled = std::chrono::steady_clock::now();
+        const auto ready = ::poll(&data, 1, PUMP_POLL_MS);
+
+        if ((ready < 0) && (errno != EINTR))
+        {
+            return false;
+        }
+
+        if (data.revents == 0)
+        {
+            idle += std::chrono::steady_clock::now() - polled;
+
+            if (idle > idleLimit)
+            {
+                WARN("client sent no body for (=%lld) seconds.", static_cast<long long>(idleLimit.count()));
+                return false;
+            }
+            continue;
+        }
+
+#if defined(__linux__)
+        const auto moved = ::splice(sock, nullptr, pipeFd, nullptr, remaining, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+        char buf[16 * 1024];
+        auto moved = ::read(sock, buf, std::min(remaining, sizeof(buf)));
+
+        for (ssize_t put = 0; moved > 0 && put < moved; )
+        {
+            const auto n = ::write(pipeFd, buf + put, moved - put);
+
+            if (n <= 0)
+            {
+                return false;
+            }
+
+            put += n;
+        }
+#endif
+
+        if (moved > 0)
+        {
+            remaining -= static_cast<size_t>(moved);
+            idle = std::chrono::steady_clock::duration::zero();
+            continue;
+        }
+
+        if (moved == 0)
+        {
+            WARN("client closed with (=%zu) body bytes missing.", remaining);
+            return false;
+        }
+
+        if ((errno != EINTR) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+        {
+            WARN("read request body failed, error (=%s).", std::strerror(errno));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<typename Protocol>
+FastCgiClient<Protocol>* HttpGateway<Protocol>::checkout()
+{
+    std::unique_lock<std::mutex> lock(m_sync);
+
+    m_released.wait(lock, [this] {
+        return !m_idle.empty();
+    });
+
+    auto client = m_idle.back();
+    m_idle.pop_back();
+    return client;
+}
+
+template<typename Protocol>
+void HttpGateway<Protocol>::checkin(FastCgiClient<Protocol>* client)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+        m_idle.push_back(client);
+    }
+
+    m_released.notify_one();
+}
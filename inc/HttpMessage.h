@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_HTTPMESSAGE_H_
+#define INC_HTTPMESSAGE_H_
+
+#include <string>
+
+#include "Common.h"
+
+/*
+ * request line and headers of an HTTP/1.x request
+ */
+struct HttpRequestHead
+{
+    std::string method;
+    std::string target;
+    std::string version;
+    KeyValuePairs headers;
+
+    size_t contentLength = 0;
+
+    // body sent with chunked transfer coding
+    bool chunked = false;
+
+    // connection stays open after the response
+    bool keepAlive = true;
+
+    // client waits for 100 Continue before sending the body
+    bool expectContinue = false;
+
+    /**
+     * @brief value of a header, empty if absent
+     */
+    std::string header(std::string const& name) const;
+};
+
+/*
+ * connection details passed to the fcgi server as cgi params
+ */
+struct CgiContext
+{
+    std::string documentRoot;
+
+    // script for every request, a front controller; document root
+    // plus script name if empty
+    std::string scriptFilename;
+
+    // the script name ends with the first path segment carrying this
+    // extension, the rest of the path is PATH_INFO
+    std::string scriptExtension = ".php";
+
+    std::string serverSoftware;
+    std::string remoteAddr;
+    std::string remotePort;
+    std::string serverAddr;
+    std::string serverPort;
+};
+
+/**
+ * @brief parse the head of a request
+ *
+ * @param head request line and headers up to and including the empty line
+ *
+ * @return false if the head is malformed
+ */
+bool parseHttpRequestHead(std::string const& head, HttpRequestHead& request);
+
+/**
+ * @brief percent-decode a request path and resolve its dot segments
+ *
+ * @param path absolute path of a request target, without query
+ * @param clean receives the decoded path, free of empty, "." and ".."
+ * segments
+ *
+ * @return false if the path is malformed, carries a NUL, or would
+ * climb above the root
+ */
+bool normalizeRequestPath(std::string const& path, std::string& clean);
+
+/**
+ * @brief map a request to cgi params as of RFC 3875, request headers
+ * become HTTP_ params
+ *
+ * Headers whose names contain an underscore are dropped, as they would
+ * be indistinguishable from their dashed forms.
+ *
+ * @param params receives the params
+ *
+ * @return false if the request path is rejected by normalizeRequestPath
+ */
+bool httpToCgiParams(
+    HttpRequestHead const& request,
+    CgiContext const& context,
+    KeyValuePairs& params
+);
+
+/**
+ * @brief build the head of an HTTP/1.1 response from cgi headers
+ *
+ * @param chunked receives whether the body must be sent chunked, since
+ * the cgi response carries no Content-Length
+ * @param keepAlive in: the client allows keep-alive, out: the connection
+ * stays open after the response
+ * @param bodiless receives whether the response carries no body, as for
+ * HEAD requests and 204 or 304 responses
+ */
+std::string httpResponseHead(
+    KeyValuePairs const& cgiHeaders,
+    HttpRequestHead const& request,
+    bool& chunked,
+    bool& keepAlive,
+    bool& bodiless
+);
+
+/**
+ * @brief complete response without body for errors raised by the gateway
+ */
+std::string httpErrorResponse(int status, bool keepAlive);
+
+/**
+ * @brief reason phrase of a status code
+ */
+char const* httpReason(int status);
+
+#endif /* INC_HTTPMESSAGE_H_ */
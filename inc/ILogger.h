@@ -34,8 +34,17 @@
 #ifndef INC_ILOGGER_H_
 #define INC_ILOGGER_H_
 
+#include <atomic>
 #include <string>
 
+/*
+ * lowest level compiled in: 0 debug, 1 info, 2 warn, 3 error, 4 fatal.
+ * macros below it are compiled out, their arguments are never evaluated.
+ */
+#ifndef FCGI_CLIENT_LOG_LEVEL
+#define FCGI_CLIENT_LOG_LEVEL 0
+#endif
+
 /*
  * simple logger interface adapter
  */
@@ -43,10 +52,11 @@ class ILogger
 {
 public:
 
+    // ordered by severity
     enum class Level
     {
-        INFO_LEVEL,
         DEBUG_LEVEL,
+        INFO_LEVEL,
         WARN_LEVEL,
         ERROR_LEVEL,
         FATAL_LEVEL
@@ -68,32 +78,77 @@ public:
 
     static ILogger* getLogger();
 
+    /**
+     * @brief install a logger, replaced loggers are kept until exit
+     * since other threads may still be logging through them; the logger
+     * is set to the level given to setLevel
+     */
     static void emplaceLogger(ILogger* logger);
-};
 
-#define INFO(fmt, ...)                                                      \
-    do {                                                                    \
-        ILogger::getLogger()->info(__FILE__, __LINE__, fmt, ##__VA_ARGS__); \
-    } while (0)
+    /**
+     * @brief set lowest level logged by the macros, also passed to the
+     * installed logger
+     */
+    static void setLevel(Level logLevel);
 
-#define DEBUG(fmt, ...)                                                      \
-    do {                                                                     \
-        ILogger::getLogger()->debug(__FILE__, __LINE__, fmt, ##__VA_ARGS__); \
-    } while (0)
+    /**
+     * @brief test if the macros log at level, a single relaxed load
+     */
+    static bool isEnabled(Level logLevel)
+    {
+        return logLevel >= s_minLevel.load(std::memory_order_relaxed);
+    }
 
-#define WARN(fmt, ...)                                                      \
-    do {                                                                     \
-        ILogger::getLogger()->warn(__FILE__, __LINE__, fmt, ##__VA_ARGS__); \
-    } while (0)
+private:
 
-#define ERROR(fmt, ...)                                                      \
-    do {                                                                     \
-        ILogger::getLogger()->error(__FILE__, __LINE__, fmt, ##__VA_ARGS__); \
+    static std::atomic<Level> s_minLevel;
+};
+
+#define FCGI_CLIENT_LOG(level, method, fmt, ...)                                    \
+    do {                                                                           \
+        if (ILogger::isEnabled(ILogger::Level::level))                             \
+        {                                                                          \
+            ILogger::getLogger()->method(__FILE__, __LINE__, fmt, ##__VA_ARGS__);  \
+        }                                                                          \
     } while (0)
 
-#define FATAL(fmt, ...)                                                      \
-    do {                                                                     \
-        ILogger::getLogger()->fatal(__FILE__, __LINE__, fmt, ##__VA_ARGS__); \
+// compiled out, the dead call keeps arguments referenced but unevaluated
+#define FCGI_CLIENT_LOG_NOTHING(method, fmt, ...)                                   \
+    do {                                                                           \
+        if (false)                                                                 \
+        {                                                                          \
+            ILogger::getLogger()->method(__FILE__, __LINE__, fmt, ##__VA_ARGS__);  \
+        }                                                                          \
     } while (0)
 
+#if FCGI_CLIENT_LOG_LEVEL <= 0
+#define DEBUG(fmt, ...) FCGI_CLIENT_LOG(DEBUG_LEVEL, debug, fmt, ##__VA_ARGS__)
+#else
+#define DEBUG(fmt, ...) FCGI_CLIENT_LOG_NOTHING(debug, fmt, ##__VA_ARGS__)
+#endif
+
+#if FCGI_CLIENT_LOG_LEVEL <= 1
+#define INFO(fmt, ...) FCGI_CLIENT_LOG(INFO_LEVEL, info, fmt, ##__VA_ARGS__)
+#else
+#define INFO(fmt, ...) FCGI_CLIENT_LOG_NOTHING(info, fmt, ##__VA_ARGS__)
+#endif
+
+#if FCGI_CLIENT_LOG_LEVEL <= 2
+#define WARN(fmt, ...) FCGI_CLIENT_LOG(WARN_LEVEL, warn, fmt, ##__VA_ARGS__)
+#else
+#define WARN(fmt, ...) FCGI_CLIENT_LOG_NOTHING(warn, fmt, ##__VA_ARGS__)
+#endif
+
+#if FCGI_CLIENT_LOG_LEVEL <= 3
+#define ERROR(fmt, ...) FCGI_CLIENT_LOG(ERROR_LEVEL, error, fmt, ##__VA_ARGS__)
+#else
+#define ERROR(fmt, ...) FCGI_CLIENT_LOG_NOTHING(error, fmt, ##__VA_ARGS__)
+#endif
+
+#if FCGI_CLIENT_LOG_LEVEL <= 4
+#define FATAL(fmt, ...) FCGI_CLIENT_LOG(FATAL_LEVEL, fatal, fmt, ##__VA_ARGS__)
+#else
+#define FATAL(fmt, ...) FCGI_CLIENT_LOG_NOTHING(fatal, fmt, ##__VA_ARGS__)
+#endif
+
 #endif /* INC_ILOGGER_H_ */
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_METRICS_H_
+#define INC_METRICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * event counter spread over cache line sized shards, so threads
+ * counting at once do not contend on a single line.
+ *
+ * thread-safe class
+ */
+class ShardedCounter final
+{
+public:
+
+    static const size_t SHARDS = 8;
+
+    void add(uint64_t value = 1);
+
+    uint64_t value() const;
+
+private:
+
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> value{ 0 };
+    };
+
+    Shard m_shards[SHARDS];
+};
+
+struct HistogramSnapshot
+{
+    uint64_t count = 0;
+    uint64_t sumUs = 0;
+    std::vector<uint64_t> buckets;
+
+    /**
+     * @brief latency at quantile q in [0, 1], zero without samples
+     */
+    std::chrono::microseconds percentile(double q) const;
+
+    /**
+     * @brief samples no larger than bound
+     *
+     * Exact when bound is the upper bound of a bucket, otherwise samples
+     * of the bucket straddling bound are left out.
+     */
+    uint64_t countAtMost(std::chrono::microseconds bound) const;
+};
+
+/*
+ * latency histogram with log-linear buckets: 16 buckets per power of
+ * two, so a recorded value is within 1/16 of its bucket bound, from
+ * 1us up to about 19 hours.
+ *
+ * thread-safe class
+ */
+class LatencyHistogram final
+{
+public:
+
+    static const size_t SUB_BUCKETS = 16;
+    static const size_t BUCKETS = 33 * SUB_BUCKETS;
+
+    void record(std::chrono::microseconds latency);
+
+    HistogramSnapshot snapshot() const;
+
+    static size_t bucketOf(uint64_t us);
+
+    /**
+     * @brief largest value falling into bucket
+     */
+    static uint64_t bucketUpper(size_t bucket);
+
+private:
+
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> sumUs{ 0 };
+        std::atomic<uint64_t> buckets[BUCKETS];
+
+        Shard();
+    };
+
+    Shard m_shards[ShardedCounter::SHARDS];
+};
+
+/*
+ * client metrics of one fcgi server
+ */
+struct EndpointMetrics
+{
+    ShardedCounter requests;
+    ShardedCounter failures;
+    ShardedCounter timeouts;
+    ShardedCounter closed;
+    ShardedCounter connects;
+    ShardedCounter connectFailures;
+    ShardedCounter staleConnections;
+    ShardedCounter bytesSent;
+    ShardedCounter bytesReceived;
+
+    // whole request, as seen by the caller
+    LatencyHistogram total;
+
+    // opening the connection
+    LatencyHistogram connect;
+
+    // request start until the first response record
+    LatencyHistogram firstByte;
+
+    // request written until FCGI_END_REQUEST
+    LatencyHistogram server;
+};
+
+struct EndpointSnapshot
+{
+    std::string endpoint;
+    uint64_t requests = 0;
+    uint64_t failures = 0;
+    uint64_t timeouts = 0;
+    uint64_t closed = 0;
+    uint64_t connects = 0;
+    uint64_t connectFailures = 0;
+    uint64_t staleConnections = 0;
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+    HistogramSnapshot total;
+    HistogramSnapshot connect;
+    HistogramSnapshot firstByte;
+    HistogramSnapshot server;
+};
+
+/*
+ * registry of endpoint metrics, shared by clients and pools. Recording
+ * is lock free; only registering an endpoint and taking a snapshot
+ * lock the registry.
+ *
+ * thread-safe class
+ */
+class Metrics final
+{
+public:
+
+    /**
+     * @brief metrics of an endpoint, created on first use
+     *
+     * @param endpoint server address, used as label
+     */
+    std::shared_ptr<EndpointMetrics> endpoint(std::string const& endpoint);
+
+    std::vector<EndpointSnapshot> snapshot() const;
+
+    /**
+     * @brief format a snapshot in the prometheus text exposition format
+     */
+    static std::string toPrometheus(std::vector<EndpointSnapshot> const& snapshot);
+
+private:
+
+    mutable std::mutex m_sync;
+    std::map<std::string, std::shared_ptr<EndpointMetrics>> m_endpoints;
+};
+
+#endif /* INC_METRICS_H_ */
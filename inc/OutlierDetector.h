@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_OUTLIERDETECTOR_H_
+#define INC_OUTLIERDETECTOR_H_
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "Common.h"
+
+/*
+ * thresholds deciding when an endpoint is ejected and for how long
+ */
+struct OutlierConfig
+{
+    // errors in a row (timeout, i/o error, closed) before ejection
+    uint32_t consecutiveErrors = 5;
+
+    // smoothed error rate above which an endpoint is ejected
+    double maxErrorRate = 0.5;
+
+    // eject when smoothed latency exceeds this multiple of the peer median
+    double latencyFactor = 5.0;
+
+    // samples needed before latency and error rate are judged
+    uint32_t minSamples = 20;
+
+    // first ejection period, doubled on every further ejection
+    std::chrono::milliseconds baseEjection{ 1000 };
+    std::chrono::milliseconds maxEjection{ 60000 };
+
+    // period over which a re-admitted endpoint ramps back to full weight
+    std::chrono::milliseconds rampUp{ 10000 };
+
+    // never eject more than this share of endpoints
+    uint32_t maxEjectionPercent = 50;
+};
+
+/*
+ * tracks latency and error rate per endpoint and temporarily ejects
+ * the ones that behave much worse than their peers.
+ *
+ * no thread-safe class
+ */
+class OutlierDetector final
+{
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Constructor
+     *
+     * @param endpoints number of tracked endpoints
+     * @param config ejection thresholds
+     */
+    explicit OutlierDetector(size_t endpoints, OutlierConfig const& config = OutlierConfig());
+
+    /**
+     * @brief record the outcome of one request
+     *
+     * @param endpoint index of the endpoint that served the request
+     * @param rc OK, or the transport error which ended the request
+     * @param latency time spent on the request
+     */
+    void record(
+        size_t endpoint,
+        ReturnCode rc,
+        std::chrono::microseconds latency,
+        Clock::time_point now = Clock::now()
+    );
+
+    /**
+     * @brief test if endpoint is currently ejected from selection
+     */
+    bool isEjected(size_t endpoint, Clock::time_point now = Clock::now()) const;
+
+    /**
+     * @brief selection weight of endpoint
+     *
+     * @return 0 while ejected, ramping linearly back to 1 after re-admission
+     */
+    double weight(size_t endpoint, Clock::time_point now = Clock::now()) const;
+
+    /**
+     * @brief smoothed latency of endpoint in microseconds
+     */
+    double latency(size_t endpoint) const;
+
+private:
+
+    struct EndpointStats
+    {
+        double latencyUs = 0.0;
+        double errorRate = 0.0;
+        uint64_t samples = 0;
+        uint32_t consecutiveErrors = 0;
+        uint32_t ejections = 0;
+        Clock::time_point ejectedUntil;
+    };
+
+    bool isLatencyOutlier(size_t endpoint) const;
+
+    size_t ejectedCount(Clock::time_point now) const;
+
+    void eject(size_t endpoint, Clock::time_point now);
+
+    OutlierConfig m_config;
+    std::vector<EndpointStats> m_stats;
+};
+
+#endif /* INC_OUTLIERDETECTOR_H_ */
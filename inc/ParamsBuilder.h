@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_PARAMSBUILDER_H_
+#define INC_PARAMSBUILDER_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+
+/*
+ * non-owning reference to the characters of a param name or value
+ */
+struct ParamRef
+{
+    // a null string refers to an empty one
+    ParamRef(const char* str)
+        : data((str != nullptr) ? str : "")
+        , size((str != nullptr) ? std::strlen(str) : 0)
+    {
+    }
+
+    ParamRef(std::string const& str)
+        : data(str.data())
+        , size(str.size())
+    {
+    }
+
+    ParamRef(const char* str, size_t len)
+        : data(str)
+        , size(len)
+    {
+    }
+
+    const char* data;
+    size_t size;
+};
+
+/*
+ * FCGI_PARAMS of a request, encoded as they are added. The encoded
+ * pairs are kept in an inline buffer and only move to the heap once
+ * they outgrow it, so typical requests are built without allocating.
+ *
+ * no thread-safe class
+ */
+class ParamsBuilder final
+{
+    static const size_t INLINE_CAPACITY = 2048;
+
+public:
+
+    ParamsBuilder() = default;
+
+    ParamsBuilder(ParamsBuilder const& other);
+    ParamsBuilder& operator=(ParamsBuilder const& other);
+
+    /**
+     * @brief add a param, values may be empty
+     *
+     * Params without name are ignored, references are not kept.
+     */
+    ParamsBuilder& add(ParamRef name, ParamRef value);
+
+    /**
+     * @brief add a param with a decimal integer value
+     */
+    ParamsBuilder& add(ParamRef name, int64_t value);
+
+    /**
+     * @brief add name-value pairs, in order
+     */
+    ParamsBuilder& add(KeyValuePairs const& pairs);
+
+    /**
+     * @brief look up the value of the first param of that name
+     *
+     * @param value receives a reference into the builder, valid until
+     * the next add
+     *
+     * @return false if there is no such param
+     */
+    bool find(ParamRef name, ParamRef& value) const;
+
+    /**
+     * @brief test if a param of that name was added
+     */
+    bool contains(ParamRef name) const;
+
+    /**
+     * @brief number of params added
+     */
+    size_t count() const;
+
+    /**
+     * @brief encoded name-value pairs, without record headers
+     */
+    const char* data() const;
+    size_t size() const;
+
+    /**
+     * @brief bytes appendRecords adds, record headers included
+     */
+    size_t recordsSize() const;
+
+    /**
+     * @brief append the params as FCGI_PARAMS records, without the
+     * empty record marking their end
+     */
+    void appendRecords(std::string& out, uint16_t requestId) const;
+
+    void clear();
+
+private:
+
+    char* reserve(size_t len);
+
+    char m_inline[INLINE_CAPACITY];
+    std::vector<char> m_heap;
+    size_t m_size = 0;
+    size_t m_count = 0;
+};
+
+#endif /* INC_PARAMSBUILDER_H_ */
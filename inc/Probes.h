@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_PROBES_H_
+#define INC_PROBES_H_
+
+/*
+ * USDT static tracepoints of provider fcgi_client, built in with the
+ * FCGI_CLIENT_USDT cmake option. An unattached probe is a single nop;
+ * without the option the macros compile to nothing.
+ *
+ *   request__start   request id, role, request bytes
+ *   request__end     request id, return code, response bytes
+ *   request__timeout request id
+ *   record__decode   request id, record type, content length
+ *   socket__write    bytes, error code
+ *   socket__read     bytes, return code
+ *   connect          1 if connected, microseconds taken
+ *
+ * e.g. bpftrace -e 'usdt:./app:fcgi_client:request__end { @[arg1] = count(); }'
+ */
+#if defined(FCGI_CLIENT_USDT)
+
+#include <sys/sdt.h>
+
+#define FCGI_PROBE1(name, a1) DTRACE_PROBE1(fcgi_client, name, a1)
+#define FCGI_PROBE2(name, a1, a2) DTRACE_PROBE2(fcgi_client, name, a1, a2)
+#define FCGI_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(fcgi_client, name, a1, a2, a3)
+
+#else
+
+// sizeof keeps the arguments used without evaluating them
+#define FCGI_PROBE1(name, a1) do { (void)sizeof(a1); } while (0)
+#define FCGI_PROBE2(name, a1, a2) do { (void)sizeof(a1); (void)sizeof(a2); } while (0)
+#define FCGI_PROBE3(name, a1, a2, a3) do { (void)sizeof(a1); (void)sizeof(a2); (void)sizeof(a3); } while (0)
+
+#endif
+
+#endif /* INC_PROBES_H_ */
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_RESPONSECACHE_H_
+#define INC_RESPONSECACHE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Common.h"
+
+/*
+ * response cache settings
+ */
+struct CacheConfig
+{
+    // caching is opt-in
+    bool enabled = false;
+
+    // params whose values form the cache key
+    std::vector<std::string> keyParams{
+        "REQUEST_METHOD", "HTTP_HOST", "SCRIPT_FILENAME", "REQUEST_URI", "QUERY_STRING"
+    };
+
+    // memory used by cached responses, split evenly over the shards
+    size_t maxBytes = 64 * 1024 * 1024;
+
+    // independently locked partitions of the cache
+    size_t shards = 16;
+
+    // freshness of responses without Cache-Control or Expires header,
+    // zero leaves them uncached
+    std::chrono::seconds defaultTtl{ 0 };
+};
+
+/*
+ * memory bounded lru cache of fcgi responses. Freshness follows the
+ * Cache-Control (max-age, s-maxage, stale-while-revalidate, no-store,
+ * no-cache, private) and Expires headers of the cgi response header
+ * block.
+ *
+ * thread-safe class
+ */
+class ResponseCache final
+{
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    enum class Freshness
+    {
+        MISS,   // not cached, or stale beyond revalidation window
+        FRESH,  // cached response may be used as is
+        STALE,  // cached response may be used while it is refreshed
+    };
+
+    /**
+     * Constructor
+     *
+     * @param config key params and memory bound
+     */
+    explicit ResponseCache(CacheConfig const& config = CacheConfig());
+
+    bool isEnabled() const;
+
+    /**
+     * @brief build cache key of a request from the configured params
+     *
+     * @return false if the request carries none of them, it is not cached
+     */
+    bool key(KeyValuePairs const& pairs, std::string& cacheKey) const;
+
+    /**
+     * @brief look up cached response
+     *
+     * @param key cache key of the request
+     * @param response receives the cached response unless MISS
+     */
+    Freshness lookup(
+        std::string const& key,
+        std::shared_ptr<const std::string>& response,
+        Clock::time_point now = Clock::now()
+    );
+
+    /**
+     * @brief cache response if its headers allow it
+     *
+     * Ends a refresh claimed with beginRefresh.
+     */
+    void store(
+        std::string const& key,
+        std::shared_ptr<const std::string> const& response,
+        Clock::time_point now = Clock::now()
+    );
+
+    /**
+     * @brief claim the refresh of a stale entry
+     *
+     * @return false if another caller already refreshes it
+     */
+    bool beginRefresh(std::string const& key);
+
+    /**
+     * @brief give up a refresh claimed with beginRefresh
+     */
+    void abandonRefresh(std::string const& key);
+
+    /**
+     * @brief derive freshness from the cgi response header block
+     *
+     * @param response cgi response, headers followed by body
+     * @param defaultTtl freshness when no header sets one
+     * @param ttl receives freshness lifetime
+     * @param staleTtl receives period a stale response may still be served
+     *
+     * @return false if response must not be cached
+     */
+    static bool parsePolicy(
+        std::string const& response,
+        std::chrono::seconds defaultTtl,
+        std::chrono::seconds& ttl,
+        std::chrono::seconds& staleTtl
+    );
+
+private:
+
+    struct Entry
+    {
+        std::string key;
+        std::shared_ptr<const std::string> response;
+        Clock::time_point freshUntil;
+        Clock::time_point staleUntil;
+        bool refreshing = false;
+    };
+
+    struct Shard
+    {
+        std::mutex sync;
+        std::list<Entry> lru;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    Shard& shardOf(std::string const& key);
+
+    void erase(Shard& shard, std::list<Entry>::iterator entry);
+
+    CacheConfig m_config;
+    size_t m_shardBytes;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+#endif /* INC_RESPONSECACHE_H_ */
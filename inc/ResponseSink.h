@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_RESPONSESINK_H_
+#define INC_RESPONSESINK_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <sys/types.h>
+
+/*
+ * memory shared by the response sinks of a client or pool
+ *
+ * thread-safe class
+ */
+class MemoryBudget final
+{
+public:
+
+    /**
+     * Constructor
+     *
+     * @param limit bytes the sinks may hold in memory together
+     */
+    explicit MemoryBudget(size_t limit);
+
+    /**
+     * @brief reserve memory for response bytes
+     *
+     * @return false if the budget would be exceeded
+     */
+    bool reserve(size_t bytes);
+
+    void release(size_t bytes);
+
+    size_t used() const;
+
+private:
+
+    MemoryBudget(MemoryBudget const&) = delete;
+    MemoryBudget& operator=(MemoryBudget const&) = delete;
+
+    const size_t m_limit;
+    std::atomic<size_t> m_used{ 0 };
+};
+
+struct SinkConfig
+{
+    // bytes of one response kept in memory
+    size_t memoryLimit = 1024 * 1024;
+
+    // move responses outgrowing memory to a file, or fail the append
+    bool spill = true;
+
+    // directory of the temp files taking larger responses
+    std::string spillDir = "/tmp";
+
+    // caller owned descriptor used instead of a temp file, if set
+    int spillFd = -1;
+
+    // receives the response as it arrives instead of the sink keeping
+    // it, if set; returning false fails the append
+    std::function<bool(const char* data, size_t len)> consumer;
+};
+
+/*
+ * destination of a response, kept in memory while small and moved
+ * to an unlinked temp file once it outgrows its memory limit or the
+ * shared budget.
+ *
+ * no thread-safe class
+ */
+class ResponseSink final
+{
+public:
+
+    explicit ResponseSink(
+        SinkConfig const& config = SinkConfig(),
+        std::shared_ptr<MemoryBudget> const& budget = nullptr
+    );
+
+    ~ResponseSink();
+
+    /**
+     * @brief append response bytes
+     *
+     * @return false if spilling to file failed
+     */
+    bool append(const char* data, size_t len);
+
+    /**
+     * @brief drop the content, the sink may be reused
+     */
+    void clear();
+
+    size_t size() const;
+
+    /**
+     * @brief test if the response was moved to a file
+     */
+    bool isSpilled() const;
+
+    /**
+     * @brief test if an append failed for lack of memory, with
+     * spilling disabled
+     */
+    bool isOverLimit() const;
+
+    /**
+     * @brief content of a response kept in memory
+     */
+    std::string const& memory() const;
+
+    /**
+     * @brief map the whole response into memory
+     *
+     * Spilled responses are memory mapped, the view stays valid until
+     * the sink is appended to, cleared or destroyed.
+     */
+    bool view(const char*& data, size_t& len);
+
+    /**
+     * @brief read part of the response
+     *
+     * @param offset position in the response
+     *
+     * @return bytes read, zero at end of response or on error
+     */
+    size_t read(size_t offset, char* buf, size_t len) const;
+
+    /**
+     * @brief move the response into a string
+     *
+     * Responses in memory are moved without copy, the sink is empty
+     * afterwards.
+     */
+    bool take(std::string& out);
+
+private:
+
+    ResponseSink(ResponseSink const&) = delete;
+    ResponseSink& operator=(ResponseSink const&) = delete;
+
+    bool spill();
+
+    bool writeFile(const char* data, size_t len);
+
+    void unmap();
+
+    SinkConfig m_config;
+    std::shared_ptr<MemoryBudget> m_budget;
+    std::string m_memory;
+    size_t m_reserved = 0;
+    size_t m_size = 0;
+    int m_fd = -1;
+    off_t m_base = 0;
+    void* m_map = nullptr;
+    size_t m_mapLen = 0;
+    bool m_overLimit = false;
+};
+
+#endif /* INC_RESPONSESINK_H_ */
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_RETRYBUDGET_H_
+#define INC_RETRYBUDGET_H_
+
+#include <cstddef>
+
+/*
+ * when and how often failed idempotent requests are sent again
+ */
+struct RetryConfig
+{
+    // retrying is opt-in
+    bool enabled = false;
+
+    // further attempts of a single request
+    size_t maxRetries = 1;
+
+    // retries allowed as a percentage of all requests
+    double budgetPercent = 10.0;
+};
+
+/*
+ * limits retries with a token bucket refilled by every request, so a
+ * failing server does not see its load multiplied by retries.
+ *
+ * no thread-safe class
+ */
+class RetryBudget final
+{
+public:
+
+    /**
+     * Constructor
+     *
+     * @param config retry count and budget
+     */
+    explicit RetryBudget(RetryConfig const& config = RetryConfig());
+
+    /**
+     * @brief test if retrying is enabled
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief further attempts allowed for a single request
+     */
+    size_t maxRetries() const;
+
+    /**
+     * @brief account a new request, earning a share of a retry
+     */
+    void onRequest();
+
+    /**
+     * @brief take one retry from the budget
+     *
+     * @return false if the budget is exhausted
+     */
+    bool tryAcquire();
+
+private:
+
+    RetryConfig m_config;
+    double m_tokens = 0.0;
+};
+
+#endif /* INC_RETRYBUDGET_H_ */
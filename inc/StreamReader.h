@@ -39,10 +39,12 @@
 #include <future>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "asio.hpp"
 
 #include "Common.h"
+#include "TransportProfile.h"
 
 /*
  * no thread-safe class
@@ -51,6 +53,7 @@ template<typename Protocol>
 class StreamReader final
 {
     static const std::chrono::seconds DEFAULT_WAIT;
+    static const size_t RECEIVE_BUFFER_SIZE;
 
 public:
 
@@ -64,13 +67,19 @@ public:
     /**
      * @brief open the socket for read
      *
-     * @param dest peer ip address
-     * @param port peer listen port
+     * The connect runs asynchronously and is given up once the profile
+     * connect timeout passes.
+     *
+     * @param endpoint peer address
+     * @param profile socket options of the connection
      *
      * @return true if socket opened successfully,
      * false if failed to open socket.
      */
-    bool open(typename Protocol::endpoint const& endpoint);
+    bool open(
+        typename Protocol::endpoint const& endpoint,
+        TransportProfile const& profile = TransportProfile()
+    );
 
     /**
      * @brief write data to network
@@ -83,9 +92,42 @@ public:
      */
     ReturnCode write(std::string const& data);
 
+    /**
+     * @brief gather write of several buffers in as few syscalls as possible
+     *
+     * @param buffers data to be written, in order
+     *
+     * @return OK if write data to socket successfully
+     * @return IO_ERROR if write error occurs
+     * @return CLOED if peer socket closed
+     */
+    ReturnCode write(std::vector<asio::const_buffer> const& buffers);
+
+    /**
+     * @brief write prefix followed by data moved from a descriptor
+     *
+     * On linux the data never enters user space: regular files are sent
+     * with sendfile(2), pipes with splice(2). The prefix is sent with
+     * MSG_MORE so the kernel can put it in the same segment as the data.
+     *
+     * @param prefix bytes written ahead of the data
+     * @param fd regular file or pipe
+     * @param offset file position, advanced by len; nullptr for pipes
+     * @param len exact number of bytes to move from fd
+     *
+     * @return OK if all data written to socket successfully
+     * @return IO_ERROR if write error occurs or fd ends early
+     * @return CLOED if peer socket closed
+     */
+    ReturnCode write(std::string const& prefix, int fd, off_t* offset, size_t len);
+
     /**
      * @brief read up to len of bytes data into buffer provided by caller
      *
+     * Short reads are served from a receive buffer filled with whatever
+     * the socket has queued, so a burst of small records costs a single
+     * receive.
+     *
      * @param buf read buffer supplied by caller
      * @param len buffer capacity
      * @param expire maximum wait period
@@ -110,14 +152,33 @@ public:
      */
     bool isOpen() const;
 
+    /**
+     * @brief test if an idle stream is still usable
+     *
+     * Peeks at the socket without blocking. A peer that closed the
+     * connection reads as end of file, and bytes arriving while no
+     * request is outstanding mean the stream is out of step.
+     *
+     * @return true if the stream is open with nothing pending
+     */
+    bool isAlive();
+
 private:
 
+    void applyProfile(int family);
+
     void readHandler(asio::error_code const& ec, std::size_t bytesXferred);
     void timeoutHandler(asio::error_code const& ec);
 
     asio::basic_stream_socket<Protocol> m_sock;
     asio::steady_timer m_responseTimer;
     std::unique_ptr<std::promise<ReturnCode>> m_result;
+    TransportProfile m_profile;
+    bool m_quickAck = false;
+    std::vector<char> m_rxBuf;
+    size_t m_rxBegin = 0;
+    size_t m_rxEnd = 0;
+    size_t m_xferred = 0;
 };
 
 #include "StreamReaderImpl.h"
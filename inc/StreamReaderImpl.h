@@ -33,38 +33,116 @@
 
 #include "StreamReader.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#endif
+
 #include "asio/basic_stream_socket.hpp"
 #include "ILogger.h"
+#include "Probes.h"
 
 template<typename Protocol>
 const std::chrono::seconds StreamReader<Protocol>::DEFAULT_WAIT(5);
 
+template<typename Protocol>
+const size_t StreamReader<Protocol>::RECEIVE_BUFFER_SIZE(64 * 1024);
+
 template<typename Protocol>
 StreamReader<Protocol>::StreamReader(asio::io_context& ioCtx)
     : m_sock(ioCtx)
     , m_responseTimer(ioCtx)
+    , m_rxBuf(RECEIVE_BUFFER_SIZE)
 {
 }
 
 template<typename Protocol>
-bool StreamReader<Protocol>::open(typename Protocol::endpoint const& endpoint)
+bool StreamReader<Protocol>::open(
+    typename Protocol::endpoint const& endpoint,
+    TransportProfile const& profile
+)
 {
-    asio::error_code ec;
-    m_sock.connect(endpoint, ec);
+    m_rxBegin = m_rxEnd = 0;
+    m_profile = profile;
+
+    std::promise<asio::error_code> connected;
+    auto f = connected.get_future();
+    auto done = std::make_shared<bool>(false);
+
+    m_sock.async_connect(endpoint, [&connected, done] (asio::error_code const& ec) {
+        *done = true;
+        connected.set_value(ec);
+    });
+
+    // the deadline only cancels the connect, its handler reports the outcome
+    m_responseTimer.expires_after(
+        (endpoint.protocol().family() == AF_UNIX) ? profile.unixConnectTimeout : profile.connectTimeout
+    );
+    m_responseTimer.async_wait([this, done] (asio::error_code const& ec) {
+        if (!ec && !*done)
+        {
+            asio::error_code ignored;
+            m_sock.cancel(ignored);
+        }
+    });
+
+    auto ec = f.get();
+    asio::error_code ignored;
+    m_responseTimer.cancel(ignored);
 
     if (ec)
     {
         WARN(
             "unable to connect to host, code (=%d), error (=%s).",
             ec.value(),
-            ec.message().c_str()
+            (ec == asio::error::operation_aborted) ? "connect timed out" : ec.message().c_str()
         );
+
+        // a failed connect leaves the socket open but unusable
+        m_sock.close(ec);
         return false;
     }
 
+    applyProfile(endpoint.protocol().family());
     return m_sock.is_open();
 }
 
+template<typename Protocol>
+bool StreamReader<Protocol>::isAlive()
+{
+    if (!m_sock.is_open() || (m_rxEnd > m_rxBegin))
+    {
+        return false;
+    }
+
+    char c;
+    const auto got = ::recv(m_sock.native_handle(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+
+    if (got == 0)
+    {
+        INFO("peer closed idle stream (=%d).", m_sock.native_handle());
+        return false;
+    }
+
+    if (got > 0)
+    {
+        WARN("unexpected data on idle stream (=%d).", m_sock.native_handle());
+        return false;
+    }
+
+    return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+}
+
 template<typename Protocol>
 ReturnCode StreamReader<Protocol>::write(std::string const& data)
 {
@@ -75,7 +153,32 @@ ReturnCode StreamReader<Protocol>::write(std::string const& data)
     }
 
     asio::error_code ec;
-    asio::write(m_sock, asio::const_buffer(data.c_str(), data.length()), ec);
+    const auto written = asio::write(m_sock, asio::const_buffer(data.c_str(), data.length()), ec);
+
+    FCGI_PROBE2(socket__write, written, ec.value());
+
+    if (ec)
+    {
+        WARN("write error, code (=%d), error (=%s).", ec.value(), ec.message().c_str());
+        return ReturnCode::IO_ERROR;
+    }
+
+    return ReturnCode::OK;
+}
+
+template<typename Protocol>
+ReturnCode StreamReader<Protocol>::write(std::vector<asio::const_buffer> const& buffers)
+{
+    if (!m_sock.is_open())
+    {
+        WARN("unable to write, socket closed.");
+        return ReturnCode::CLOSED;
+    }
+
+    asio::error_code ec;
+    const auto written = asio::write(m_sock, buffers, ec);
+
+    FCGI_PROBE2(socket__write, written, ec.value());
 
     if (ec)
     {
@@ -86,6 +189,109 @@ ReturnCode StreamReader<Protocol>::write(std::string const& data)
     return ReturnCode::OK;
 }
 
+template<typename Protocol>
+ReturnCode StreamReader<Protocol>::write(
+    std::string const& prefix,
+    int fd,
+    off_t* offset,
+    size_t len
+)
+{
+    if (!m_sock.is_open())
+    {
+        WARN("unable to write, socket closed.");
+        return ReturnCode::CLOSED;
+    }
+
+    asio::error_code ec;
+    size_t written(0);
+    const size_t total = prefix.length() + len;
+
+    while (written < prefix.length())
+    {
+        written += m_sock.send(
+            asio::const_buffer(prefix.data() + written, prefix.length() - written),
+            MSG_MORE,
+            ec
+        );
+
+        if (ec)
+        {
+            WARN("write error, code (=%d), error (=%s).", ec.value(), ec.message().c_str());
+            return (ec == asio::error::broken_pipe) ? ReturnCode::CLOSED : ReturnCode::IO_ERROR;
+        }
+    }
+
+    const int sock = m_sock.native_handle();
+
+    while (len > 0)
+    {
+#if defined(__linux__)
+        const auto moved = (offset != nullptr)
+            ? ::sendfile(sock, fd, offset, len)
+            : ::splice(fd, nullptr, sock, nullptr, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+#else
+        char buf[64 * 1024];
+        auto moved = (offset != nullptr)
+            ? ::pread(fd, buf, std::min(len, sizeof(buf)), *offset)
+            : ::read(fd, buf, std::min(len, sizeof(buf)));
+
+        if (moved > 0)
+        {
+            asio::write(m_sock, asio::const_buffer(buf, moved), ec);
+
+            if (ec)
+            {
+                WARN("write error, code (=%d), error (=%s).", ec.value(), ec.message().c_str());
+                return ReturnCode::IO_ERROR;
+            }
+
+            if (offset != nullptr)
+            {
+                *offset += moved;
+            }
+        }
+#endif
+
+        if (moved > 0)
+        {
+            len -= static_cast<size_t>(moved);
+            continue;
+        }
+
+        if (moved == 0)
+        {
+            WARN("body descriptor ended early, %zu bytes missing.", len);
+            return ReturnCode::IO_ERROR;
+        }
+
+        if (errno == EINTR)
+        {
+            continue;
+        }
+
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            // asio keeps the socket non-blocking once async reads started
+            struct pollfd pfd = { sock, POLLOUT, 0 };
+            const auto waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(DEFAULT_WAIT);
+
+            if (::poll(&pfd, 1, static_cast<int>(waitMs.count())) <= 0)
+            {
+                WARN("socket not writable in time.");
+                return ReturnCode::TIMEOUT;
+            }
+            continue;
+        }
+
+        WARN("write error, code (=%d), error (=%s).", errno, std::strerror(errno));
+        return ((errno == EPIPE) || (errno == ECONNRESET)) ? ReturnCode::CLOSED : ReturnCode::IO_ERROR;
+    }
+
+    FCGI_PROBE2(socket__write, total, 0);
+    return ReturnCode::OK;
+}
+
 template<typename Protocol>
 ReturnCode StreamReader<Protocol>::read(
     char* buf,
@@ -93,6 +299,32 @@ ReturnCode StreamReader<Protocol>::read(
     std::chrono::seconds const& expire
 )
 {
+    // serve what the last receive already buffered
+    const auto buffered = std::min(len, m_rxEnd - m_rxBegin);
+
+    std::memcpy(buf, m_rxBuf.data() + m_rxBegin, buffered);
+    m_rxBegin += buffered;
+    buf += buffered;
+    len -= buffered;
+
+    if (len == 0)
+    {
+        return ReturnCode::OK;
+    }
+
+    // large reads go straight to the caller buffer
+    const bool direct = (len >= m_rxBuf.size());
+    m_rxBegin = m_rxEnd = 0;
+
+#if defined(TCP_QUICKACK)
+    // the kernel leaves quick ack mode on its own, re-arm per receive
+    if (m_quickAck)
+    {
+        const int on(1);
+        ::setsockopt(m_sock.native_handle(), IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+    }
+#endif
+
     m_result.reset(new std::promise<ReturnCode>());
     auto f = m_result->get_future();
     if (expire.count() != 0)
@@ -106,15 +338,21 @@ ReturnCode StreamReader<Protocol>::read(
             )
         );
     }
-    asio::async_read(
-        m_sock,
-        asio::buffer(buf, len),
-        std::bind(
-            &StreamReader::readHandler, this,
-            std::placeholders::_1,  // error code
-            std::placeholders::_2   // bytes xferred
-        )
+    auto handler = std::bind(
+        &StreamReader::readHandler, this,
+        std::placeholders::_1,  // error code
+        std::placeholders::_2   // bytes xferred
     );
+
+    if (direct)
+    {
+        asio::async_read(m_sock, asio::buffer(buf, len), handler);
+    }
+    else
+    {
+        asio::async_read(m_sock, asio::buffer(m_rxBuf), asio::transfer_at_least(len), handler);
+    }
+
     auto rc = f.get();
     asio::error_code ec;
 
@@ -140,12 +378,23 @@ ReturnCode StreamReader<Protocol>::read(
             break;
     }
 
+    if ((rc == ReturnCode::OK) && !direct)
+    {
+        std::memcpy(buf, m_rxBuf.data(), len);
+        m_rxBegin = len;
+        m_rxEnd = m_xferred;
+    }
+
+    FCGI_PROBE2(socket__read, (rc == ReturnCode::OK) ? (direct ? len : m_xferred) : 0, static_cast<int>(rc));
+
     return rc;
 }
 
 template<typename Protocol>
 void StreamReader<Protocol>::close()
 {
+    m_rxBegin = m_rxEnd = 0;
+
     if (!m_sock.is_open())
         return;
 
@@ -164,6 +413,50 @@ bool StreamReader<Protocol>::isOpen() const
     return m_sock.is_open();
 }
 
+template<typename Protocol>
+void StreamReader<Protocol>::applyProfile(int family)
+{
+    const int sock = m_sock.native_handle();
+    const bool tcp = (family == AF_INET) || (family == AF_INET6);
+
+    auto setOption = [sock] (int level, int name, int value, const char* label) {
+        if (::setsockopt(sock, level, name, &value, sizeof(value)) != 0)
+        {
+            WARN("set socket option %s failed, error (=%s).", label, std::strerror(errno));
+        }
+    };
+
+    if (tcp && m_profile.noDelay)
+    {
+        setOption(IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    }
+
+    const int sendBuffer = ((family == AF_UNIX) && (m_profile.sendBuffer <= 0))
+        ? m_profile.unixSendBuffer
+        : m_profile.sendBuffer;
+
+    if (sendBuffer > 0)
+    {
+        setOption(SOL_SOCKET, SO_SNDBUF, sendBuffer, "SO_SNDBUF");
+    }
+
+    if (m_profile.receiveBuffer > 0)
+    {
+        setOption(SOL_SOCKET, SO_RCVBUF, m_profile.receiveBuffer, "SO_RCVBUF");
+    }
+
+#if defined(SO_BUSY_POLL)
+    if (tcp && (m_profile.busyPollUs > 0))
+    {
+        setOption(SOL_SOCKET, SO_BUSY_POLL, m_profile.busyPollUs, "SO_BUSY_POLL");
+    }
+#endif
+
+#if defined(TCP_QUICKACK)
+    m_quickAck = tcp && m_profile.quickAck;
+#endif
+}
+
 template<typename Protocol>
 void StreamReader<Protocol>::readHandler(
     asio::error_code const& ec,
@@ -187,7 +480,7 @@ void StreamReader<Protocol>::readHandler(
     }
     else
     {
-        // socket closed
+        m_xferred = bytesXferred;
         m_result->set_value(ReturnCode::OK);
     }
 }
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_TRACE_H_
+#define INC_TRACE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "Common.h"
+#include "ParamsBuilder.h"
+
+/*
+ * phase timestamps of one traced request, unset phases were not reached
+ */
+struct TraceSpan
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::string traceId;
+    std::string endpoint;
+    uint16_t requestId = 0;
+    ReturnCode status = ReturnCode::OK;
+
+    // wall clock time of entered, to match server side logs
+    std::chrono::system_clock::time_point wallStart;
+
+    // request handed to the client
+    Clock::time_point entered;
+
+    // connection lock taken, the difference to entered is queue wait
+    Clock::time_point acquired;
+
+    // request records built
+    Clock::time_point encoded;
+
+    // request completely written to the socket
+    Clock::time_point written;
+
+    // first STDOUT record received
+    Clock::time_point firstStdout;
+
+    // FCGI_END_REQUEST received, or the request failed
+    Clock::time_point ended;
+
+    /**
+     * @brief microseconds from phase begin to phase end, -1 if either
+     * was not reached
+     */
+    static int64_t elapsedUs(Clock::time_point begin, Clock::time_point end);
+};
+
+/*
+ * receives finished spans on the thread that ran the request, so it
+ * should hand them off rather than block
+ */
+class ISpanExporter
+{
+public:
+
+    virtual ~ISpanExporter() = default;
+
+    virtual void exportSpan(TraceSpan const& span) = 0;
+};
+
+/*
+ * exports spans as log lines
+ */
+class LogSpanExporter final : public ISpanExporter
+{
+public:
+
+    void exportSpan(TraceSpan const& span) override;
+};
+
+struct TracerConfig
+{
+    // param carrying the caller supplied trace id
+    std::string traceParam = "HTTP_X_REQUEST_ID";
+
+    // share of trace ids traced, from 0 to 1
+    double sampleRate = 1.0;
+};
+
+/*
+ * decides which requests are traced and passes their spans on.
+ * Requests are traced when they carry a trace id param; sampling
+ * hashes the id, so every client keeps or drops the same traces.
+ *
+ * thread-safe class
+ */
+class Tracer final
+{
+public:
+
+    explicit Tracer(
+        std::shared_ptr<ISpanExporter> const& exporter,
+        TracerConfig const& config = TracerConfig()
+    );
+
+    /**
+     * @brief start a span if the request is to be traced
+     *
+     * @param params request params, searched for the trace id
+     * @param span receives the trace id
+     *
+     * @return true if the request is traced
+     */
+    bool begin(ParamsBuilder const& params, TraceSpan& span) const;
+
+    /**
+     * @brief hand a finished span to the exporter
+     */
+    void finish(TraceSpan const& span) const;
+
+private:
+
+    std::shared_ptr<ISpanExporter> m_exporter;
+    TracerConfig m_config;
+    uint64_t m_threshold;
+};
+
+#endif /* INC_TRACE_H_ */
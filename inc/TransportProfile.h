@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_TRANSPORTPROFILE_H_
+#define INC_TRANSPORTPROFILE_H_
+
+#include <chrono>
+
+/*
+ * socket options applied to a connection when it is opened. TCP only
+ * options are skipped for unix domain endpoints.
+ */
+struct TransportProfile
+{
+    // send small records at once instead of waiting to coalesce them
+    bool noDelay = true;
+
+    // acknowledge responses immediately, re-armed before each receive
+    bool quickAck = false;
+
+    // socket buffer sizes in bytes, system default if zero
+    int sendBuffer = 0;
+    int receiveBuffer = 0;
+
+    // microseconds to busy poll the device queue on receive, off if zero
+    int busyPollUs = 0;
+
+    // connect attempts are given up after this period
+    std::chrono::milliseconds connectTimeout{ 3000 };
+
+    // unix domain endpoints: send buffer used when sendBuffer is zero,
+    // large enough to queue a full record with its padding without the
+    // writer waiting on the peer
+    int unixSendBuffer = 256 * 1024;
+
+    // unix domain endpoints: a local connect completes or fails at once
+    // unless the listen backlog is full, so give up sooner
+    std::chrono::milliseconds unixConnectTimeout{ 500 };
+};
+
+#endif /* INC_TRANSPORTPROFILE_H_ */
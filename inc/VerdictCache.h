@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_VERDICTCACHE_H_
+#define INC_VERDICTCACHE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Common.h"
+
+/*
+ * outcome of a request to a fcgi authorizer
+ */
+struct AuthorizerVerdict
+{
+    // authorizer answered with status 200
+    bool authorized = false;
+
+    // cgi status of the authorizer response
+    int status = 0;
+
+    // Variable-NAME headers, passed on as NAME params to the responder
+    KeyValuePairs variables;
+
+    // full authorizer response, sent to the client when unauthorized
+    std::string response;
+
+    /**
+     * @brief fill verdict from an authorizer response
+     *
+     * @return false if response has no complete header block
+     */
+    bool parse(std::string const& authorizerResponse);
+};
+
+/*
+ * verdict cache settings
+ */
+struct VerdictCacheConfig
+{
+    // params carrying the credentials, the cache key is built from them
+    std::vector<std::string> keyParams{ "HTTP_AUTHORIZATION", "HTTP_COOKIE" };
+
+    // how long granted and denied (401, 403) verdicts are reused
+    std::chrono::seconds allowTtl{ 60 };
+    std::chrono::seconds denyTtl{ 5 };
+
+    // verdicts kept, least recently used ones are dropped first
+    size_t maxEntries = 10000;
+};
+
+/*
+ * caches authorizer verdicts per set of credentials, so repeated
+ * authorizations are answered without a server round trip.
+ *
+ * thread-safe class
+ */
+class VerdictCache final
+{
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Constructor
+     *
+     * @param config credential params, lifetimes and size bound
+     */
+    explicit VerdictCache(VerdictCacheConfig const& config = VerdictCacheConfig());
+
+    /**
+     * @brief build cache key from the credential params
+     *
+     * @return false if the request carries none of them
+     */
+    bool key(KeyValuePairs const& pairs, std::string& cacheKey) const;
+
+    /**
+     * @brief look up a verdict that has not expired yet
+     */
+    bool lookup(
+        std::string const& cacheKey,
+        AuthorizerVerdict& verdict,
+        Clock::time_point now = Clock::now()
+    );
+
+    /**
+     * @brief keep a verdict, only status 200, 401 and 403 are kept
+     */
+    void store(
+        std::string const& cacheKey,
+        AuthorizerVerdict const& verdict,
+        Clock::time_point now = Clock::now()
+    );
+
+private:
+
+    struct Entry
+    {
+        std::string key;
+        AuthorizerVerdict verdict;
+        Clock::time_point expire;
+    };
+
+    VerdictCacheConfig m_config;
+    std::mutex m_sync;
+    std::list<Entry> m_lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+};
+
+#endif /* INC_VERDICTCACHE_H_ */
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_WORKERPOOL_H_
+#define INC_WORKERPOOL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Common.h"
+#include "FastCGIClient.h"
+#include "TransportProfile.h"
+#include "WorkerProcess.h"
+
+/*
+ * worker pool settings
+ */
+struct WorkerConfig
+{
+    // program and arguments of a worker, such as { "php-cgi" }
+    std::vector<std::string> command;
+
+    // KEY=VALUE entries added to the environment of the workers, they
+    // replace inherited entries of the same name
+    std::vector<std::string> environment;
+
+    // directory of the worker sockets
+    std::string socketDir = "/tmp";
+
+    // workers kept warm, and the upper bound under load
+    size_t minWorkers = 2;
+    size_t maxWorkers = 8;
+
+    // a worker is replaced after serving this many requests, 0 never
+    size_t maxRequests = 1000;
+
+    // a worker is replaced once its resident memory grows past this, 0 never
+    size_t maxResidentBytes = 0;
+
+    // workers above minWorkers idle this long are stopped
+    std::chrono::seconds idleTimeout{ 30 };
+
+    // period of the supervisor checks
+    std::chrono::milliseconds superviseInterval{ 250 };
+
+    // time a stopping worker gets before it is killed
+    std::chrono::milliseconds stopGrace{ 2000 };
+
+    // socket options of the worker connections
+    TransportProfile transport;
+};
+
+struct WorkerPoolStats
+{
+    size_t workers = 0;
+    size_t busy = 0;
+    size_t waiting = 0;
+    uint64_t spawned = 0;
+    uint64_t recycled = 0;
+    uint64_t crashed = 0;
+};
+
+/*
+ * spawns and supervises local fcgi worker processes and sends requests
+ * to them, one connection per worker. Workers are recycled after a
+ * request count or on memory growth, replaced when they die, and added
+ * while requests wait for a free worker, up to maxWorkers.
+ *
+ * Protocol is asio::local::stream_protocol.
+ *
+ * thread-safe class
+ */
+template<typename Protocol>
+class WorkerPool final
+{
+    static const std::chrono::seconds DEFAULT_WAIT;
+
+public:
+
+    explicit WorkerPool(WorkerConfig const& config);
+
+    ~WorkerPool();
+
+    /**
+     * @brief start minWorkers workers and the supervisor
+     *
+     * @return true if at least one worker started
+     */
+    bool start();
+
+    /**
+     * @brief stop the supervisor and all workers
+     */
+    void stop();
+
+    /**
+     * @brief send request to a free worker
+     *
+     * @param status OK once the request completed, TIMEOUT if no worker
+     * became free in time, or the transport error
+     * @param timeout bound for the whole call, waiting for a worker included
+     */
+    bool sendRequest(
+        KeyValuePairs const& pairs,
+        std::string const& body,
+        std::string& response,
+        ReturnCode& status,
+        std::chrono::seconds const& timeout = DEFAULT_WAIT);
+
+    WorkerPoolStats stats() const;
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Worker
+    {
+        std::unique_ptr<WorkerProcess> process;
+        std::unique_ptr<FastCgiClient<Protocol>> client;
+        size_t served = 0;
+        bool busy = false;
+        bool retiring = false;
+        Clock::time_point idleSince;
+    };
+
+    WorkerPool(WorkerPool const&) = delete;
+    WorkerPool& operator=(WorkerPool const&) = delete;
+
+    std::unique_ptr<Worker> spawn();
+
+    void supervise();
+
+    void retire(std::unique_ptr<Worker> worker);
+
+    WorkerConfig m_config;
+    mutable std::mutex m_sync;
+    std::condition_variable m_released;
+    std::condition_variable m_demand;
+    std::list<std::unique_ptr<Worker>> m_workers;
+    size_t m_waiting = 0;
+    uint64_t m_sequence = 0;
+    WorkerPoolStats m_counts;
+    bool m_running = false;
+    std::thread m_supervisor;
+};
+
+#include "WorkerPoolImpl.h"
+
+#endif /* INC_WORKERPOOL_H_ */
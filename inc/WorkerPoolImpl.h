@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "ILogger.h"
+
+template<typename Protocol>
+const std::chrono::seconds WorkerPool<Protocol>::DEFAULT_WAIT(300);
+
+template<typename Protocol>
+WorkerPool<Protocol>::WorkerPool(WorkerConfig const& config)
+    : m_config(config)
+{
+    m_config.minWorkers = std::max<size_t>(m_config.minWorkers, 1);
+    m_config.maxWorkers = std::max(m_config.maxWorkers, m_config.minWorkers);
+}
+
+template<typename Protocol>
+WorkerPool<Protocol>::~WorkerPool()
+{
+    stop();
+}
+
+template<typename Protocol>
+bool WorkerPool<Protocol>::start()
+{
+    for (size_t i = 0; i < m_config.minWorkers; ++i)
+    {
+        auto worker = spawn();
+
+        if (worker)
+        {
+            std::lock_guard<std::mutex> lock(m_sync);
+            m_workers.push_back(std::move(worker));
+            ++m_counts.spawned;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_sync);
+
+    if (m_workers.empty())
+    {
+        WARN("no fcgi worker could be started.");
+        return false;
+    }
+
+    m_running = true;
+    m_supervisor = std::thread(&WorkerPool::supervise, this);
+    return true;
+}
+
+template<typename Protocol>
+void WorkerPool<Protocol>::stop()
+{
+    std::list<std::unique_ptr<Worker>> workers;
+
+    {
+        std::unique_lock<std::mutex> lock(m_sync);
+        m_running = false;
+        m_demand.notify_all();
+        m_released.notify_all();
+
+        // requests in flight finish on their workers first
+        m_released.wait(lock, [this] {
+            return std::none_of(m_workers.begin(), m_workers.end(), [] (std::unique_ptr<Worker> const& worker) {
+                return worker->busy;
+            });
+        });
+
+        workers.swap(m_workers);
+    }
+
+    if (m_supervisor.joinable())
+    {
+        m_supervisor.join();
+    }
+
+    for (auto& worker : workers)
+    {
+        retire(std::move(worker));
+    }
+}
+
+template<typename Protocol>
+bool WorkerPool<Protocol>::sendRequest(
+    KeyValuePairs const& pairs,
+    std::string const& body,
+    std::string& response,
+    ReturnCode& status,
+    std::chrono::seconds const& timeout
+)
+{
+    const auto deadline = Clock::now() + timeout;
+    std::chrono::seconds remaining(0);
+    Worker* worker(nullptr);
+
+    auto findIdle = [this] () -> Worker* {
+        for (auto& candidate : m_workers)
+        {
+            if (!candidate->busy && !candidate->retiring)
+            {
+                return candidate.get();
+            }
+        }
+
+        return nullptr;
+    };
+
+    {
+        std::unique_lock<std::mutex> lock(m_sync);
+
+        ++m_waiting;
+
+        while (m_running && ((worker = findIdle()) == nullptr))
+        {
+            // a waiting request may warrant another worker
+            m_demand.notify_one();
+
+            if (m_released.wait_until(lock, deadline) == std::cv_status::timeout)
+            {
+                worker = m_running ? findIdle() : nullptr;
+                break;
+            }
+        }
+
+        --m_waiting;
+
+        if (worker == nullptr)
+        {
+            status = m_running ? ReturnCode::TIMEOUT : ReturnCode::CLOSED;
+            return false;
+        }
+
+        // the time spent waiting for a worker counts against the timeout,
+        // rounded up to the whole seconds the client works with
+        const auto left = deadline - Clock::now();
+
+        if (left <= Clock::duration::zero())
+        {
+            // leave the idle worker to the next waiting request
+            m_released.notify_one();
+            status = ReturnCode::TIMEOUT;
+            return false;
+        }
+
+        remaining = std::chrono::duration_cast<std::chrono::seconds>(left + std::chrono::seconds(1) - Clock::duration(1));
+        worker->busy = true;
+    }
+
+    const bool ret = worker->client->sendRequest(pairs, body, response, status, remaining);
+
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+
+        worker->busy = false;
+        worker->idleSince = Clock::now();
+        ++worker->served;
+
+        // a failed exchange leaves the worker in an unknown state
+        if ((status != ReturnCode::OK)
+            || ((m_config.maxRequests > 0) && (worker->served >= m_config.maxRequests)))
+        {
+            worker->retiring = true;
+            m_demand.notify_one();
+        }
+    }
+
+    if (m_running)
+    {
+        m_released.notify_one();
+    }
+    else
+    {
+        m_released.notify_all();
+    }
+
+    return ret;
+}
+
+template<typename Protocol>
+WorkerPoolStats WorkerPool<Protocol>::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_sync);
+
+    auto stats = m_counts;
+    stats.workers = m_workers.size();
+    stats.waiting = m_waiting;
+    stats.busy = std::count_if(m_workers.begin(), m_workers.end(), [] (std::unique_ptr<Worker> const& worker) {
+        return worker->busy;
+    });
+
+    return stats;
+}
+
+template<typename Protocol>
+std::unique_ptr<typename WorkerPool<Protocol>::Worker> WorkerPool<Protocol>::spawn()
+{
+    uint64_t seq;
+
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+        seq = ++m_sequence;
+    }
+
+    const auto path = m_config.socketDir + "/fcgi-worker-" + std::to_string(::getpid())
+        + "-" + std::to_string(seq) + ".sock";
+
+    std::unique_ptr<Worker> worker(new Worker());
+    worker->process.reset(new WorkerProcess(m_config.command, m_config.environment, path));
+
+    if (!worker->process->spawn())
+    {
+        return nullptr;
+    }
+
+    // the socket listens already, so the worker need not be up yet
+    worker->client.reset(new FastCgiClient<Protocol>(typename Protocol::endpoint(path), m_config.transport));
+
+    if (!worker->client->openConnection())
+    {
+        WARN("connect to worker (=%s) failed.", path.c_str());
+        return nullptr;
+    }
+
+    worker->idleSince = Clock::now();
+    return worker;
+}
+
+template<typename Protocol>
+void WorkerPool<Protocol>::supervise()
+{
+    std::unique_lock<std::mutex> lock(m_sync);
+
+    while (m_running)
+    {
+        m_demand.wait_for(lock, m_config.superviseInterval);
+
+        if (!m_running)
+        {
+            break;
+        }
+
+        const auto now = Clock::now();
+        std::vector<std::unique_ptr<Worker>> leaving;
+        bool scaledDown(false);
+
+        for (auto it = m_workers.begin(); it != m_workers.end(); )
+        {
+            auto& worker = *it;
+
+            if (worker->busy)
+            {
+                ++it;
+                continue;
+            }
+
+            const bool dead = !worker->process->isRunning();
+            const bool bloated = !dead && (m_config.maxResidentBytes > 0)
+                && (worker->process->residentBytes() > m_config.maxResidentBytes);
+
+            // one idle worker above the minimum goes per round
+            const bool surplus = !scaledDown && (m_workers.size() > m_config.minWorkers)
+                && (m_waiting == 0) && (now - worker->idleSince > m_config.idleTimeout);
+
+            if (dead || bloated || worker->retiring || surplus)
+            {
+                m_counts.crashed += dead ? 1 : 0;
+                m_counts.recycled += (!dead && (bloated || worker->retiring)) ? 1 : 0;
+                scaledDown = scaledDown || surplus;
+                leaving.push_back(std::move(worker));
+                it = m_workers.erase(it);
+                continue;
+            }
+
+            ++it;
+        }
+
+        const size_t busy = std::count_if(m_workers.begin(), m_workers.end(), [] (std::unique_ptr<Worker> const& worker) {
+            return worker->busy;
+        });
+        const size_t wanted = std::min(
+            m_config.maxWorkers,
+            std::max(m_config.minWorkers, scaledDown ? m_workers.size() : busy + m_waiting)
+        );
+        const size_t missing = (wanted > m_workers.size()) ? wanted - m_workers.size() : 0;
+
+        lock.unlock();
+
+        // replacements start before the old workers stop, keeping the pool warm
+        for (size_t i = 0; i < missing; ++i)
+        {
+            auto worker = spawn();
+
+            if (!worker)
+            {
+                break;
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(m_sync);
+                m_workers.push_back(std::move(worker));
+                ++m_counts.spawned;
+            }
+
+            m_released.notify_one();
+        }
+
+        for (auto& worker : leaving)
+        {
+            retire(std::move(worker));
+        }
+
+        lock.lock();
+    }
+}
+
+template<typename Protocol>
+void WorkerPool<Protocol>::retire(std::unique_ptr<Worker> worker)
+{
+    if (worker)
+    {
+        worker->client->closeConnection();
+        worker->process->terminate(m_config.stopGrace);
+    }
+}
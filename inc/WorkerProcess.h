@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INC_WORKERPROCESS_H_
+#define INC_WORKERPROCESS_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+/*
+ * local fcgi worker process. The worker inherits a unix listening
+ * socket of its own as descriptor 0, as fcgi applications such as
+ * php-cgi expect, so no accept queue is shared between workers.
+ *
+ * no thread-safe class
+ */
+class WorkerProcess final
+{
+public:
+
+    /**
+     * Constructor
+     *
+     * @param command program and arguments of the worker
+     * @param environment KEY=VALUE entries added to the inherited ones,
+     * replacing inherited entries of the same name
+     * @param socketPath path of the listening socket, replaced if present
+     */
+    WorkerProcess(
+        std::vector<std::string> const& command,
+        std::vector<std::string> const& environment,
+        std::string const& socketPath
+    );
+
+    /**
+     * Destructor, terminates the worker
+     */
+    ~WorkerProcess();
+
+    /**
+     * @brief bind the socket and start the worker
+     *
+     * Connecting succeeds from here on, the connection is accepted
+     * once the worker is up.
+     */
+    bool spawn();
+
+    /**
+     * @brief test if the worker still runs, reaping it otherwise
+     */
+    bool isRunning();
+
+    /**
+     * @brief resident memory of the worker, zero if unknown
+     */
+    size_t residentBytes() const;
+
+    /**
+     * @brief stop the worker, killing it after the grace period
+     */
+    void terminate(std::chrono::milliseconds const& grace);
+
+    pid_t pid() const;
+
+    std::string const& socketPath() const;
+
+private:
+
+    WorkerProcess(WorkerProcess const&) = delete;
+    WorkerProcess& operator=(WorkerProcess const&) = delete;
+
+    std::vector<std::string> m_command;
+    std::vector<std::string> m_environment;
+    std::string m_socketPath;
+    pid_t m_pid = -1;
+};
+
+#endif /* INC_WORKERPROCESS_H_ */
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "AdmissionQueue.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+// smoothing factor of the service time moving average
+static const double EWMA_ALPHA = 0.1;
+
+bool AdmissionQueue::Earlier::operator()(Ticket const& lhs, Ticket const& rhs) const
+{
+    if (lhs.priority != rhs.priority)
+    {
+        return lhs.priority > rhs.priority;
+    }
+
+    if (lhs.deadline != rhs.deadline)
+    {
+        return lhs.deadline < rhs.deadline;
+    }
+
+    return lhs.seq < rhs.seq;
+}
+
+AdmissionQueue::AdmissionQueue(size_t capacity)
+    : m_capacity(capacity)
+{
+}
+
+bool AdmissionQueue::isEmpty() const
+{
+    return m_waiters.empty();
+}
+
+bool AdmissionQueue::isFull() const
+{
+    return m_waiters.size() >= m_capacity;
+}
+
+AdmissionQueue::Ticket AdmissionQueue::push(Clock::time_point deadline, int priority)
+{
+    Ticket ticket{ priority, deadline, m_seq++ };
+    m_waiters.insert(ticket);
+    return ticket;
+}
+
+void AdmissionQueue::remove(Ticket const& ticket)
+{
+    m_waiters.erase(ticket);
+}
+
+bool AdmissionQueue::isHead(Ticket const& ticket) const
+{
+    return !m_waiters.empty() && (m_waiters.begin()->seq == ticket.seq);
+}
+
+std::chrono::microseconds AdmissionQueue::predict(
+    Clock::time_point deadline,
+    int priority,
+    size_t concurrency
+) const
+{
+    if (m_serviceUs <= 0.0)
+    {
+        return std::chrono::microseconds(0);
+    }
+
+    // a new ticket sorts after every waiter with the same key
+    const Ticket probe{ priority, deadline, std::numeric_limits<uint64_t>::max() };
+    const auto ahead = std::distance(m_waiters.begin(), m_waiters.lower_bound(probe));
+    const auto slots = static_cast<double>(std::max<size_t>(concurrency, 1));
+    const auto rounds = (static_cast<double>(ahead) + 1.0) / slots;
+
+    return std::chrono::microseconds(
+        static_cast<int64_t>((rounds + 1.0) * m_serviceUs)
+    );
+}
+
+void AdmissionQueue::recordService(std::chrono::microseconds service)
+{
+    const auto sample = static_cast<double>(service.count());
+
+    if (m_serviceUs <= 0.0)
+    {
+        m_serviceUs = sample;
+    }
+    else
+    {
+        m_serviceUs += EWMA_ALPHA * (sample - m_serviceUs);
+    }
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "AsyncLogger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+
+const size_t AsyncLogger::RING_CAPACITY(512);
+const size_t AsyncLogger::MAX_MESSAGE;
+
+static const std::chrono::milliseconds FLUSH_PERIOD(20);
+static const size_t MAX_TIME_BUF_SIZE = 20;
+
+static std::atomic<uint64_t> gLoggerIds{ 0 };
+
+static const char* levelName(ILogger::Level level)
+{
+    switch (level)
+    {
+        case ILogger::Level::INFO_LEVEL:  return "info";
+        case ILogger::Level::DEBUG_LEVEL: return "debug";
+        case ILogger::Level::WARN_LEVEL:  return "warn";
+        case ILogger::Level::ERROR_LEVEL: return "error";
+        case ILogger::Level::FATAL_LEVEL: return "fatal";
+    }
+
+    return "";
+}
+
+namespace
+{
+
+/*
+ * ring of the calling thread, handed back when the thread exits
+ */
+struct LocalRing
+{
+    ~LocalRing()
+    {
+        if (ring)
+        {
+            owned->store(false, std::memory_order_release);
+        }
+    }
+
+    uint64_t loggerId = 0;
+    std::shared_ptr<void> ring;
+    std::atomic<bool>* owned = nullptr;
+};
+
+thread_local LocalRing gLocalRing;
+
+} // sealed namespace
+
+AsyncLogger::Ring::Ring(size_t capacity)
+    : slots(capacity)
+{
+}
+
+AsyncLogger::AsyncLogger()
+    : m_id(++gLoggerIds)
+{
+    m_worker = std::thread(&AsyncLogger::run, this);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sync);
+        m_stop = true;
+    }
+
+    m_wakeup.notify_one();
+
+    if (m_worker.joinable())
+    {
+        m_worker.join();
+    }
+}
+
+void AsyncLogger::setLogLevel(Level logLevel)
+{
+    m_level.store(logLevel, std::memory_order_relaxed);
+}
+
+void AsyncLogger::info(const char* const fileName, unsigned long line, const char* const fmt...)
+{
+    if (isLoggable(Level::INFO_LEVEL))
+    {
+        va_list args;
+        va_start(args, fmt);
+        log(Level::INFO_LEVEL, fileName, line, fmt, args);
+        va_end(args);
+    }
+}
+
+void AsyncLogger::debug(const char* const fileName, unsigned long line, const char* const fmt...)
+{
+    if (isLoggable(Level::DEBUG_LEVEL))
+    {
+        va_list args;
+        va_start(args, fmt);
+        log(Level::DEBUG_LEVEL, fileName, line, fmt, args);
+        va_end(args);
+    }
+}
+
+void AsyncLogger::warn(const char* const fileName, unsigned long line, const char* const fmt...)
+{
+    if (isLoggable(Level::WARN_LEVEL))
+    {
+        va_list args;
+        va_start(args, fmt);
+        log(Level::WARN_LEVEL, fileName, line, fmt, args);
+        va_end(args);
+    }
+}
+
+void AsyncLogger::error(const char* const fileName, unsigned long line, const char* const fmt...)
+{
+    if (isLoggable(Level::ERROR_LEVEL))
+    {
+        va_list args;
+        va_start(args, fmt);
+        log(Level::ERROR_LEVEL, fileName, line, fmt, args);
+        va_end(args);
+    }
+}
+
+void AsyncLogger::fatal(const char* const fileName, unsigned long line, const char* const fmt...)
+{
+    if (isLoggable(Level::FATAL_LEVEL))
+    {
+        va_list args;
+        va_start(args, fmt);
+        log(Level::FATAL_LEVEL, fileName, line, fmt, args);
+        va_end(args);
+    }
+}
+
+bool AsyncLogger::isLoggable(Level logLevel) const
+{
+    return logLevel >= m_level.load(std::memory_order_relaxed);
+}
+
+void AsyncLogger::log(
+    Level logLevel,
+    const char* const fileName,
+    unsigned long line,
+    const char* const fmt,
+    va_list& arg
+)
+{
+    auto& ring = localRing();
+    const auto head = ring.head.load(std::memory_order_relaxed);
+    const auto used = head - ring.tail.load(std::memory_order_acquire);
+
+    if (used >= ring.slots.size())
+    {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    auto& record = ring.slots[head % ring.slots.size()];
+
+    record.time = std::chrono::system_clock::now();
+    record.fileName = fileName;
+    record.line = line;
+    record.level = logLevel;
+
+    // longer messages are truncated to the slot
+    if (std::vsnprintf(record.message, sizeof(record.message), fmt, arg) < 0)
+    {
+        record.message[0] = '\0';
+    }
+
+    ring.head.store(head + 1, std::memory_order_release);
+
+    if (used + 1 == ring.slots.size() / 2)
+    {
+        // wake the writer early rather than drop records
+        m_wakeup.notify_one();
+    }
+}
+
+AsyncLogger::Ring& AsyncLogger::localRing()
+{
+    auto& local = gLocalRing;
+
+    if (local.loggerId == m_id)
+    {
+        return *static_cast<Ring*>(local.ring.get());
+    }
+
+    if (local.ring)
+    {
+        // ring of a replaced logger
+        local.owned->store(false, std::memory_order_release);
+    }
+
+    std::lock_guard<std::mutex> lock(m_sync);
+    std::shared_ptr<Ring> ring;
+
+    for (auto const& candidate : m_rings)
+    {
+        bool expected(false);
+
+        if (candidate->owned.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+        {
+            ring = candidate;
+            break;
+        }
+    }
+
+    if (!ring)
+    {
+        ring = std::make_shared<Ring>(RING_CAPACITY);
+        m_rings.push_back(ring);
+    }
+
+    local.loggerId = m_id;
+    local.ring = ring;
+    local.owned = &ring->owned;
+    return *ring;
+}
+
+void AsyncLogger::run()
+{
+    std::vector<Record> batch;
+    std::vector<std::shared_ptr<Ring>> rings;
+
+    while (true)
+    {
+        bool stop(false);
+
+        {
+            std::unique_lock<std::mutex> lock(m_sync);
+            m_wakeup.wait_for(lock, FLUSH_PERIOD, [this] { return m_stop; });
+            stop = m_stop;
+            rings = m_rings;
+        }
+
+        size_t dropped(0);
+
+        for (auto const& ring : rings)
+        {
+            const auto tail = ring->tail.load(std::memory_order_relaxed);
+            const auto head = ring->head.load(std::memory_order_acquire);
+
+            for (auto pos = tail; pos != head; ++pos)
+            {
+                batch.push_back(ring->slots[pos % ring->slots.size()]);
+            }
+
+            ring->tail.store(head, std::memory_order_release);
+            dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+        }
+
+        if (!batch.empty() || (dropped > 0))
+        {
+            write(batch, dropped);
+            batch.clear();
+        }
+
+        if (stop)
+        {
+            break;
+        }
+    }
+}
+
+void AsyncLogger::write(std::vector<Record>& batch, size_t dropped)
+{
+    // rings are drained one after another, restore the order of records
+    std::stable_sort(batch.begin(), batch.end(), [] (Record const& lhs, Record const& rhs) {
+        return lhs.time < rhs.time;
+    });
+
+    std::string out;
+    char tbuf[MAX_TIME_BUF_SIZE] = { 0 };
+    time_t formatted(-1);
+
+    for (auto const& record : batch)
+    {
+        const auto secs = std::chrono::system_clock::to_time_t(record.time);
+
+        // one localtime call per second of records
+        if (secs != formatted)
+        {
+            struct tm nowTm;
+            localtime_r(&secs, &nowTm);
+            std::strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", &nowTm);
+            formatted = secs;
+        }
+
+        auto pNameNoPath = std::strrchr(record.fileName, '/');
+
+        out.append(tbuf);
+        out.append("[ ").append(levelName(record.level)).append(" ]  [ ");
+        out.append(pNameNoPath == nullptr ? record.fileName : pNameNoPath + 1);
+        out.append(":").append(std::to_string(record.line)).append(" ] ");
+        out.append(record.message);
+        out.append("\n");
+    }
+
+    if (dropped > 0)
+    {
+        out.append(std::to_string(dropped)).append(" log records dropped, rings full\n");
+    }
+
+    std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+    std::cout.flush();
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Capture.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ILogger.h"
+
+static const char MAGIC[] = "FCGICAP1";
+static const size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+
+TrafficCapture::TrafficCapture(std::string const& path, CaptureConfig const& config)
+    : m_fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))
+    , m_config(config)
+    , m_opened(std::chrono::steady_clock::now())
+    , m_offset(MAGIC_SIZE)
+{
+    const auto rate = std::min(std::max(config.sampleRate, 0.0), 1.0);
+
+    // every stride-th request is captured, none at rate 0
+    m_stride = (rate > 0) ? static_cast<uint64_t>(std::llround(1.0 / rate)) : 0;
+
+    if (m_fd < 0)
+    {
+        WARN("open capture (=%s) failed (=%s).", path.c_str(), std::strerror(errno));
+    }
+    else if (::pwrite(m_fd, MAGIC, MAGIC_SIZE, 0) != static_cast<ssize_t>(MAGIC_SIZE))
+    {
+        WARN("write capture (=%s) failed (=%s).", path.c_str(), std::strerror(errno));
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+    }
+}
+
+bool TrafficCapture::isOpen() const
+{
+    return m_fd >= 0;
+}
+
+uint32_t TrafficCapture::connectionId()
+{
+    return m_connections.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+bool TrafficCapture::sample()
+{
+    return (m_fd >= 0) && (m_stride != 0)
+        && (m_sequence.fetch_add(1, std::memory_order_relaxed) % m_stride == 0);
+}
+
+void TrafficCapture::appendEvent(
+    std::string& batch,
+    CaptureEvent event,
+    uint16_t requestId,
+    uint32_t connection,
+    char const* data,
+    size_t len
+) const
+{
+    const uint32_t length = static_cast<uint32_t>(len);
+    const uint8_t type = static_cast<uint8_t>(event);
+    const uint8_t reserved = 0;
+    const uint64_t at = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - m_opened
+    ).count();
+
+    char hdr[EVENT_HEADER_SIZE];
+    std::memcpy(hdr, &length, 4);
+    std::memcpy(hdr + 4, &type, 1);
+    std::memcpy(hdr + 5, &reserved, 1);
+    std::memcpy(hdr + 6, &requestId, 2);
+    std::memcpy(hdr + 8, &connection, 4);
+    std::memcpy(hdr + 12, &at, 8);
+
+    batch.append(hdr, sizeof(hdr));
+    batch.append(data, len);
+}
+
+bool TrafficCapture::write(std::string const& batch)
+{
+    if ((m_fd < 0) || batch.empty())
+    {
+        return false;
+    }
+
+    const auto offset = m_offset.fetch_add(batch.size(), std::memory_order_relaxed);
+
+    if (offset + batch.size() > m_config.maxBytes)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    size_t written(0);
+
+    while (written < batch.size())
+    {
+        const auto put = ::pwrite(
+            m_fd, batch.data() + written, batch.size() - written, static_cast<off_t>(offset + written)
+        );
+
+        if (put <= 0)
+        {
+            // leaves a zeroed range, which load treats as the end
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        written += static_cast<size_t>(put);
+    }
+
+    return true;
+}
+
+uint64_t TrafficCapture::dropped() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+bool TrafficCapture::load(std::string const& path, std::vector<CapturedEvent>& events)
+{
+    std::ifstream file(path, std::ios::binary);
+    char magic[MAGIC_SIZE];
+
+    if (!file.read(magic, sizeof(magic)) || (std::memcmp(magic, MAGIC, MAGIC_SIZE) != 0))
+    {
+        WARN("file (=%s) is not a capture.", path.c_str());
+        return false;
+    }
+
+    char hdr[EVENT_HEADER_SIZE];
+
+    while (file.read(hdr, sizeof(hdr)))
+    {
+        uint32_t length;
+        uint8_t type;
+        uint64_t at;
+        CapturedEvent event;
+
+        std::memcpy(&length, hdr, 4);
+        std::memcpy(&type, hdr + 4, 1);
+        std::memcpy(&event.requestId, hdr + 6, 2);
+        std::memcpy(&event.connection, hdr + 8, 4);
+        std::memcpy(&at, hdr + 12, 8);
+
+        if ((type != static_cast<uint8_t>(CaptureEvent::REQUEST))
+            && (type != static_cast<uint8_t>(CaptureEvent::RECORD)))
+        {
+            WARN("capture (=%s) corrupt after (=%zu) events.", path.c_str(), events.size());
+            break;
+        }
+
+        event.event = static_cast<CaptureEvent>(type);
+        event.at = std::chrono::nanoseconds(at);
+        event.payload.resize(length);
+
+        if ((length > 0) && !file.read(&event.payload[0], length))
+        {
+            WARN("capture (=%s) truncated after (=%zu) events.", path.c_str(), events.size());
+            break;
+        }
+
+        events.push_back(std::move(event));
+    }
+
+    return true;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "CgiHeaders.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <strings.h>
+
+static const std::string STATUS_TOKEN("Status");
+
+std::string trim(std::string const& str)
+{
+    const auto first = str.find_first_not_of(" \t\r");
+
+    if (first == std::string::npos)
+    {
+        return std::string();
+    }
+
+    const auto last = str.find_last_not_of(" \t\r");
+    return str.substr(first, last - first + 1);
+}
+
+bool parseCgiHeaders(
+    std::string const& response,
+    KeyValuePairs& headers,
+    size_t& bodyOffset
+)
+{
+    auto headerEnd = response.find("\r\n\r\n");
+    bodyOffset = headerEnd + 4;
+
+    if (headerEnd == std::string::npos)
+    {
+        headerEnd = response.find("\n\n");
+        bodyOffset = headerEnd + 2;
+    }
+
+    if (headerEnd == std::string::npos)
+    {
+        return false;
+    }
+
+    headers.clear();
+    size_t pos(0);
+
+    while (pos < headerEnd)
+    {
+        auto eol = response.find('\n', pos);
+
+        if ((eol == std::string::npos) || (eol > headerEnd))
+        {
+            eol = headerEnd;
+        }
+
+        const auto colon = response.find(':', pos);
+
+        if ((colon != std::string::npos) && (colon < eol))
+        {
+            headers.push_back({
+                trim(response.substr(pos, colon - pos)),
+                trim(response.substr(colon + 1, eol - colon - 1))
+            });
+        }
+
+        pos = eol + 1;
+    }
+
+    return true;
+}
+
+bool isHeader(std::string const& name, std::string const& expected)
+{
+    return strcasecmp(name.c_str(), expected.c_str()) == 0;
+}
+
+int cgiStatus(KeyValuePairs const& headers)
+{
+    for (auto const& header : headers)
+    {
+        if (isHeader(header.first, STATUS_TOKEN))
+        {
+            return std::atoi(header.second.c_str());
+        }
+    }
+
+    return 200;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ConcurrencyLimiter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+ConcurrencyLimiter::ConcurrencyLimiter(LimiterConfig const& config)
+    : m_config(config)
+    , m_limit(static_cast<double>(config.initialLimit))
+{
+}
+
+size_t ConcurrencyLimiter::limit() const
+{
+    if (!m_config.enabled)
+    {
+        return std::numeric_limits<size_t>::max();
+    }
+
+    return static_cast<size_t>(m_limit);
+}
+
+void ConcurrencyLimiter::record(
+    ReturnCode rc,
+    std::chrono::microseconds rtt,
+    size_t inflight
+)
+{
+    if (!m_config.enabled)
+    {
+        return;
+    }
+
+    const auto minLimit = static_cast<double>(std::max<size_t>(m_config.minLimit, 1));
+    const auto maxLimit = static_cast<double>(std::max<size_t>(m_config.maxLimit, 1));
+
+    if (rc != ReturnCode::OK)
+    {
+        m_limit = std::max(minLimit, m_limit * m_config.backoffRatio);
+        return;
+    }
+
+    if ((m_samples == 0) || (rtt.count() < m_minRtt))
+    {
+        m_minRtt = std::max<int64_t>(rtt.count(), 1);
+    }
+
+    if (++m_samples >= m_config.minRttWindow)
+    {
+        // the next sample starts a new minimum, so a permanently slower
+        // server is not judged against a stale baseline forever
+        m_samples = 0;
+    }
+
+    // a limit that is not used says nothing about the server's capacity
+    if (static_cast<double>(inflight) < m_limit / 2)
+    {
+        return;
+    }
+
+    const double gradient = std::max(0.5, std::min(1.0,
+        m_config.tolerance * static_cast<double>(m_minRtt) /
+        static_cast<double>(std::max<int64_t>(rtt.count(), 1))
+    ));
+    const double headroom = std::sqrt(m_limit);
+    const double estimate = m_limit * gradient + headroom;
+
+    m_limit = m_limit * (1.0 - m_config.smoothing) + estimate * m_config.smoothing;
+    m_limit = std::max(minLimit, std::min(maxLimit, m_limit));
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FcgiCodec.h"
+
+#include <sstream>
+
+static const char KEEP_ALIVE = 0x01;
+
+std::string encodeBeginRequest(uint8_t role)
+{
+    const char beginBody[] = {
+        0x00,
+        static_cast<char>(role),
+        KEEP_ALIVE,
+        0x00, 0x00, 0x00, 0x00, 0x00
+    };
+
+    return std::string(beginBody, sizeof(beginBody));
+}
+
+std::string encodeFastCgiRecord(
+    uint8_t recType,
+    std::string const& content,
+    uint16_t requestId
+)
+{
+    std::string rtnRecord;
+
+    const auto contentLen = content.length();
+    std::ostringstream ostr;
+    ostr << static_cast<char>(FCGI_VERSION)
+         << static_cast<char>(recType)
+         << static_cast<char>((requestId >> 8) & 0xFF)
+         << static_cast<char>(requestId & 0xFF)
+         << static_cast<char>((contentLen >> 8) & 0xFF)
+         << static_cast<char>(contentLen & 0xFF)
+         << static_cast<char>(0)
+         << static_cast<char>(0)
+         << content;
+
+    rtnRecord = ostr.str();
+    return rtnRecord;
+}
+
+std::string encodeFastCgiStream(
+    uint8_t recType,
+    std::string const& content,
+    uint16_t requestId
+)
+{
+    std::string rtnRecords;
+
+    // a record carries at most 64k - 1 bytes of content
+    for (size_t pos = 0; pos < content.length(); pos += FCGI_MAX_CONTENT)
+    {
+        rtnRecords.append(
+            encodeFastCgiRecord(recType, content.substr(pos, FCGI_MAX_CONTENT), requestId)
+        );
+    }
+
+    return rtnRecords;
+}
+
+void encodeFastCgiHeader(
+    char* hdr,
+    uint8_t recType,
+    uint16_t requestId,
+    size_t contentLen
+)
+{
+    hdr[0] = static_cast<char>(FCGI_VERSION);
+    hdr[1] = static_cast<char>(recType);
+    hdr[2] = static_cast<char>((requestId >> 8) & 0xFF);
+    hdr[3] = static_cast<char>(requestId & 0xFF);
+    hdr[4] = static_cast<char>((contentLen >> 8) & 0xFF);
+    hdr[5] = static_cast<char>(contentLen & 0xFF);
+    hdr[6] = 0;
+    hdr[7] = 0;
+}
+
+std::string encodeNameValueParams(
+    std::string const& name,
+    std::string const& value
+)
+{
+    std::string rtnRecord;
+
+    // empty values are meaningful, QUERY_STRING for one
+    if (!name.empty())
+    {
+        const auto nameLen = name.length();
+        const auto valueLen = value.length();
+        std::ostringstream ostr;
+
+        if (nameLen < 128)
+        {
+            ostr << static_cast<char>(nameLen);
+        }
+        else
+        {
+            ostr << static_cast<char>((nameLen >> 24) | 0x80)
+                 << static_cast<char>((nameLen >> 16) & 0xFF)
+                 << static_cast<char>((nameLen >> 8) & 0xFF)
+                 << static_cast<char>(nameLen & 0xFF);
+        }
+
+        if (valueLen < 128)
+        {
+            ostr << static_cast<char>(valueLen);
+        }
+        else
+        {
+            ostr << static_cast<char>((valueLen >> 24) | 0x80)
+                 << static_cast<char>((valueLen >> 16) & 0xFF)
+                 << static_cast<char>((valueLen >> 8) & 0xFF)
+                 << static_cast<char>(valueLen & 0xFF);
+        }
+        ostr << name << value;
+        rtnRecord = ostr.str();
+    }
+    return rtnRecord;
+}
+
+bool decodeFastCgiHeader(
+    std::string const& buf,
+    NameTagPairs& pairs
+)
+{
+    pairs.clear();
+    pairs.insert({ VER_TOKEN,  buf[0] });
+    pairs.insert({ TYPE_TOKEN, buf[1] });
+    const uint16_t requestId = ((buf[2] & 0xFF) << 8) + (buf[3] & 0xFF);
+    pairs.insert({ REQ_ID_TOKEN, requestId });
+    const uint16_t len = ((buf[4] & 0xFF) << 8) + (buf[5] & 0xFF);
+    pairs.insert({ CONT_LEN_TOKEN, len });
+    pairs.insert({ PADDING_LEN_TOKEN, buf[6] });
+    return true;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FileDataSource.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ILogger.h"
+
+const size_t FileDataSource::DEFAULT_WINDOW(4 * 1024 * 1024);
+
+FileDataSource::FileDataSource(int fd, off_t offset, size_t length, size_t window)
+    : m_fd(fd)
+    , m_offset(offset)
+    , m_window(window)
+{
+    struct stat st;
+
+    if (::fstat(fd, &st) != 0)
+    {
+        WARN("fstat failed, error (=%s).", std::strerror(errno));
+        return;
+    }
+
+    m_valid = true;
+    m_lastModified = st.st_mtime;
+
+    if (S_ISREG(st.st_mode))
+    {
+        const auto size = static_cast<size_t>(st.st_size);
+        const auto start = std::min(static_cast<size_t>(std::max<off_t>(offset, 0)), size);
+
+        m_mappable = true;
+        m_sized = true;
+        m_offset = static_cast<off_t>(start);
+        m_remaining = (length == 0) ? size - start : std::min(length, size - start);
+
+        // windows start on page boundaries
+        const auto page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        m_window = std::max(page, m_window - m_window % page);
+    }
+    else
+    {
+        m_sized = (length != 0);
+        m_remaining = length;
+        m_buffer.reset(new char[m_window]);
+    }
+}
+
+FileDataSource::~FileDataSource()
+{
+    unmap();
+}
+
+bool FileDataSource::isValid() const
+{
+    return m_valid;
+}
+
+bool FileDataSource::length(size_t& len) const
+{
+    len = m_remaining;
+    return m_sized;
+}
+
+time_t FileDataSource::lastModified() const
+{
+    return m_lastModified;
+}
+
+bool FileDataSource::next(const char*& data, size_t& len)
+{
+    unmap();
+    len = 0;
+
+    if (!m_valid)
+    {
+        return false;
+    }
+
+    if (m_mappable)
+    {
+        if (m_remaining == 0)
+        {
+            return true;
+        }
+
+        // map from the page holding m_offset
+        const auto page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        const auto skew = static_cast<size_t>(m_offset) % page;
+        const auto chunk = std::min(m_remaining, m_window - skew);
+
+        m_mapLen = skew + chunk;
+        m_map = ::mmap(nullptr, m_mapLen, PROT_READ, MAP_SHARED, m_fd, m_offset - skew);
+
+        if (m_map == MAP_FAILED)
+        {
+            WARN("mmap failed, error (=%s).", std::strerror(errno));
+            m_map = nullptr;
+            m_mapLen = 0;
+            return false;
+        }
+
+        // advice values are not flags, each takes its own call
+        ::madvise(m_map, m_mapLen, MADV_SEQUENTIAL);
+        ::madvise(m_map, m_mapLen, MADV_WILLNEED);
+
+        data = static_cast<const char*>(m_map) + skew;
+        len = chunk;
+        m_offset += chunk;
+        m_remaining -= chunk;
+        return true;
+    }
+
+    const auto want = m_sized ? std::min(m_remaining, m_window) : m_window;
+
+    if (want == 0)
+    {
+        return true;
+    }
+
+    ssize_t got;
+
+    do
+    {
+        got = ::read(m_fd, m_buffer.get(), want);
+    }
+    while ((got < 0) && (errno == EINTR));
+
+    if (got < 0)
+    {
+        WARN("read failed, error (=%s).", std::strerror(errno));
+        return false;
+    }
+
+    if (m_sized)
+    {
+        if (got == 0)
+        {
+            // the server was promised FCGI_DATA_LENGTH bytes
+            WARN("data ended %zu bytes short of its length.", m_remaining);
+            return false;
+        }
+
+        m_remaining -= static_cast<size_t>(got);
+    }
+
+    data = m_buffer.get();
+    len = static_cast<size_t>(got);
+    return true;
+}
+
+void FileDataSource::unmap()
+{
+    if (m_map != nullptr)
+    {
+        ::munmap(m_map, m_mapLen);
+        m_map = nullptr;
+        m_mapLen = 0;
+    }
+}
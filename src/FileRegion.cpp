@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FileRegion.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "ILogger.h"
+
+bool FileRegion::isRegularFile(size_t& size) const
+{
+    struct stat st;
+
+    if ((::fstat(fd, &st) != 0) || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+
+    size = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+ReturnCode FileRegion::waitReadable(
+    size_t& available,
+    std::chrono::steady_clock::time_point expire
+) const
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int polled;
+
+    if (fd < 0)
+    {
+        WARN("invalid body descriptor (=%d).", fd);
+        return ReturnCode::IO_ERROR;
+    }
+
+    do
+    {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            expire - std::chrono::steady_clock::now()
+        ).count();
+
+        polled = ::poll(&pfd, 1, static_cast<int>(std::max<int64_t>(left, 0)));
+    } while ((polled < 0) && (errno == EINTR));
+
+    if (polled < 0)
+    {
+        WARN("poll failed, error (=%s).", std::strerror(errno));
+        return ReturnCode::IO_ERROR;
+    }
+
+    if (polled == 0)
+    {
+        WARN("body descriptor stalled (=%d).", fd);
+        return ReturnCode::TIMEOUT;
+    }
+
+    if (pfd.revents & (POLLERR | POLLNVAL))
+    {
+        WARN("poll error on body descriptor.");
+        return ReturnCode::IO_ERROR;
+    }
+
+    int ready(0);
+
+    if (::ioctl(fd, FIONREAD, &ready) != 0)
+    {
+        WARN("ioctl failed, error (=%s).", std::strerror(errno));
+        return ReturnCode::IO_ERROR;
+    }
+
+    // readable with nothing queued means the writer closed the pipe
+    available = static_cast<size_t>(ready);
+    return ReturnCode::OK;
+}
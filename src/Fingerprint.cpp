@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Fingerprint.h"
+
+#include <algorithm>
+
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static void hashBytes(uint64_t& hash, const char* data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= FNV_PRIME;
+    }
+}
+
+static void hashLength(uint64_t& hash, size_t len)
+{
+    const uint32_t len32 = static_cast<uint32_t>(len);
+    const char bytes[] = {
+        static_cast<char>((len32 >> 24) & 0xFF),
+        static_cast<char>((len32 >> 16) & 0xFF),
+        static_cast<char>((len32 >> 8) & 0xFF),
+        static_cast<char>(len32 & 0xFF),
+    };
+    hashBytes(hash, bytes, sizeof(bytes));
+}
+
+uint64_t fingerprint(KeyValuePairs const& pairs, std::string const& body)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    for (auto const& pair : pairs)
+    {
+        hashLength(hash, pair.first.length());
+        hashLength(hash, pair.second.length());
+        hashBytes(hash, pair.first.data(), pair.first.length());
+        hashBytes(hash, pair.second.data(), pair.second.length());
+    }
+
+    hashLength(hash, body.length());
+    hashBytes(hash, body.data(), body.length());
+    return hash;
+}
+
+uint64_t fingerprint(std::string const& str)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    hashBytes(hash, str.data(), str.length());
+    return hash;
+}
+
+bool paramsKey(
+    KeyValuePairs const& pairs,
+    std::vector<std::string> const& names,
+    std::string& key
+)
+{
+    bool found(false);
+    key.clear();
+
+    for (auto const& name : names)
+    {
+        auto pair = std::find_if(pairs.begin(), pairs.end(), [&name] (auto const& candidate) {
+            return candidate.first == name;
+        });
+
+        // length prefixed, so values cannot run into each other
+        if (pair != pairs.end())
+        {
+            found = true;
+            key.append(std::to_string(pair->second.length()));
+            key.push_back(':');
+            key.append(pair->second);
+        }
+        else
+        {
+            key.push_back('-');
+        }
+    }
+
+    return found;
+}
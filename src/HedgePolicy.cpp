@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "HedgePolicy.h"
+
+#include <algorithm>
+
+// latencies needed before the percentile is trusted
+static const size_t MIN_SAMPLES = 32;
+
+// recompute the percentile after this many new latencies
+static const size_t UPDATE_INTERVAL = 64;
+
+// unused budget is capped, so idle periods cannot fund a hedge burst
+static const double MAX_TOKENS = 10.0;
+
+HedgePolicy::HedgePolicy(HedgeConfig const& config)
+    : m_config(config)
+{
+    m_samples.reserve(std::max<size_t>(m_config.window, MIN_SAMPLES));
+}
+
+bool HedgePolicy::isEnabled() const
+{
+    return m_config.enabled;
+}
+
+void HedgePolicy::record(std::chrono::microseconds latency)
+{
+    // capacity() may exceed what was reserved, the window is the configured one
+    if (m_samples.size() < std::max<size_t>(m_config.window, MIN_SAMPLES))
+    {
+        m_samples.push_back(latency.count());
+    }
+    else
+    {
+        m_samples[m_next] = latency.count();
+        m_next = (m_next + 1) % m_samples.size();
+    }
+
+    ++m_sinceUpdate;
+}
+
+void HedgePolicy::onRequest()
+{
+    m_tokens = std::min(MAX_TOKENS, m_tokens + m_config.budgetPercent / 100.0);
+}
+
+bool HedgePolicy::delay(std::chrono::microseconds& delay)
+{
+    if (m_samples.size() < MIN_SAMPLES)
+    {
+        return false;
+    }
+
+    if ((m_delay.count() == 0) || (m_sinceUpdate >= UPDATE_INTERVAL))
+    {
+        std::vector<int64_t> sorted(m_samples);
+        const auto rank = std::min(
+            sorted.size() - 1,
+            static_cast<size_t>(sorted.size() * m_config.percentile / 100.0)
+        );
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+
+        m_delay = std::max<std::chrono::microseconds>(
+            std::chrono::microseconds(sorted[rank]),
+            m_config.minDelay
+        );
+        m_sinceUpdate = 0;
+    }
+
+    delay = m_delay;
+    return true;
+}
+
+bool HedgePolicy::tryAcquire()
+{
+    if (m_tokens < 1.0)
+    {
+        return false;
+    }
+
+    m_tokens -= 1.0;
+    return true;
+}
@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "HttpMessage.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <vector>
+
+#include "CgiHeaders.h"
+
+static const std::string CRLF("\r\n");
+
+// test a comma separated header value for a token, case-insensitively
+static bool hasToken(std::string const& value, std::string const& token)
+{
+    size_t pos(0);
+
+    while (pos <= value.size())
+    {
+        auto comma = value.find(',', pos);
+
+        if (comma == std::string::npos)
+        {
+            comma = value.size();
+        }
+
+        if (isHeader(trim(value.substr(pos, comma - pos)), token))
+        {
+            return true;
+        }
+
+        pos = comma + 1;
+    }
+
+    return false;
+}
+
+std::string HttpRequestHead::header(std::string const& name) const
+{
+    for (auto const& header : headers)
+    {
+        if (isHeader(header.first, name))
+        {
+            return header.second;
+        }
+    }
+
+    return std::string();
+}
+
+bool parseHttpRequestHead(std::string const& head, HttpRequestHead& request)
+{
+    auto eol = head.find(CRLF);
+
+    if (eol == std::string::npos)
+    {
+        return false;
+    }
+
+    const auto line = head.substr(0, eol);
+    const auto sp1 = line.find(' ');
+    const auto sp2 = line.rfind(' ');
+
+    if ((sp1 == std::string::npos) || (sp1 == sp2))
+    {
+        return false;
+    }
+
+    request.method = line.substr(0, sp1);
+    request.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    request.version = line.substr(sp2 + 1);
+    request.headers.clear();
+
+    if (request.method.empty() || request.target.empty()
+        || ((request.version != "HTTP/1.1") && (request.version != "HTTP/1.0")))
+    {
+        return false;
+    }
+
+    size_t pos = eol + CRLF.size();
+
+    while ((eol = head.find(CRLF, pos)) != std::string::npos)
+    {
+        if (eol == pos)
+        {
+            break;
+        }
+
+        const auto colon = head.find(':', pos);
+
+        // header names carry no white space, RFC 7230 3.2.4
+        if ((colon == std::string::npos) || (colon > eol) || (colon == pos)
+            || (head.find_first_of(" \t", pos) < colon))
+        {
+            return false;
+        }
+
+        request.headers.push_back({
+            head.substr(pos, colon - pos),
+            trim(head.substr(colon + 1, eol - colon - 1))
+        });
+
+        pos = eol + CRLF.size();
+    }
+
+    const auto connection = request.header("Connection");
+    const auto length = request.header("Content-Length");
+    const auto lengths = std::count_if(request.headers.begin(), request.headers.end(), [] (KeyValuePair const& header) {
+        return isHeader(header.first, "Content-Length");
+    });
+
+    // framing must be unambiguous, or a proxy in front may split differently
+    if (lengths > 1)
+    {
+        return false;
+    }
+
+    request.keepAlive = (request.version == "HTTP/1.1")
+        ? !hasToken(connection, "close")
+        : hasToken(connection, "keep-alive");
+    request.chunked = hasToken(request.header("Transfer-Encoding"), "chunked");
+    request.expectContinue = isHeader(request.header("Expect"), "100-continue");
+    request.contentLength = 0;
+
+    if (!length.empty())
+    {
+        if (length.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+
+        request.contentLength = std::strtoull(length.c_str(), nullptr, 10);
+    }
+
+    return true;
+}
+
+static int hexValue(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return ((c >= 'a') && (c <= 'f')) ? (c - 'a' + 10) : -1;
+}
+
+bool normalizeRequestPath(std::string const& path, std::string& clean)
+{
+    std::string decoded;
+
+    if (path.empty() || (path[0] != '/'))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        if (path[i] != '%')
+        {
+            decoded.push_back(path[i]);
+            continue;
+        }
+
+        const int high = (i + 2 < path.size()) ? hexValue(path[i + 1]) : -1;
+        const int low = (i + 2 < path.size()) ? hexValue(path[i + 2]) : -1;
+
+        if ((high < 0) || (low < 0) || ((high == 0) && (low == 0)))
+        {
+            return false;
+        }
+
+        decoded.push_back(static_cast<char>(high * 16 + low));
+        i += 2;
+    }
+
+    std::vector<std::string> segments;
+    bool directory(false);
+    size_t pos(1);
+
+    // segments are resolved after decoding, so %2e%2e climbs like ..
+    while (pos <= decoded.size())
+    {
+        auto slash = decoded.find('/', pos);
+
+        if (slash == std::string::npos)
+        {
+            slash = decoded.size();
+        }
+
+        const auto segment = decoded.substr(pos, slash - pos);
+
+        // a path ending in a slash or dot segment names a directory
+        directory = segment.empty() || (segment == ".") || (segment == "..");
+
+        if (segment == "..")
+        {
+            if (segments.empty())
+            {
+                return false;
+            }
+
+            segments.pop_back();
+        }
+        else if (!segment.empty() && (segment != "."))
+        {
+            segments.push_back(segment);
+        }
+
+        pos = slash + 1;
+    }
+
+    clean.clear();
+
+    for (auto const& segment : segments)
+    {
+        clean.append("/").append(segment);
+    }
+
+    if (clean.empty() || directory)
+    {
+        clean.append("/");
+    }
+
+    return true;
+}
+
+bool httpToCgiParams(
+    HttpRequestHead const& request,
+    CgiContext const& context,
+    KeyValuePairs& params
+)
+{
+    const auto query = request.target.find('?');
+    std::string path;
+
+    if (!normalizeRequestPath(request.target.substr(0, query), path))
+    {
+        return false;
+    }
+
+    // split the script off at the first segment with the script extension
+    std::string scriptName(path);
+    std::string pathInfo;
+    const auto& ext = context.scriptExtension;
+
+    for (auto end = path.find('/', 1); !ext.empty(); end = path.find('/', end + 1))
+    {
+        const auto segEnd = (end == std::string::npos) ? path.size() : end;
+
+        if ((segEnd >= ext.size()) && (path.compare(segEnd - ext.size(), ext.size(), ext) == 0))
+        {
+            scriptName = path.substr(0, segEnd);
+            pathInfo = path.substr(segEnd);
+            break;
+        }
+
+        if (end == std::string::npos)
+        {
+            break;
+        }
+    }
+
+    auto host = request.header("Host");
+
+    if (!host.empty() && (host[0] != '[') && (host.find(':') != std::string::npos))
+    {
+        host.erase(host.find(':'));
+    }
+
+    params = {
+        { "GATEWAY_INTERFACE", "CGI/1.1" },
+        { "SERVER_SOFTWARE", context.serverSoftware },
+        { "SERVER_PROTOCOL", request.version },
+        { "SERVER_NAME", host.empty() ? context.serverAddr : host },
+        { "SERVER_ADDR", context.serverAddr },
+        { "SERVER_PORT", context.serverPort },
+        { "REMOTE_ADDR", context.remoteAddr },
+        { "REMOTE_PORT", context.remotePort },
+        { "REQUEST_SCHEME", "http" },
+        { "REQUEST_METHOD", request.method },
+        { "REQUEST_URI", request.target },
+        { "DOCUMENT_URI", path },
+        { "SCRIPT_NAME", scriptName },
+        { "PATH_INFO", pathInfo },
+        { "QUERY_STRING", (query == std::string::npos) ? std::string() : request.target.substr(query + 1) },
+        { "DOCUMENT_ROOT", context.documentRoot },
+        { "SCRIPT_FILENAME", context.scriptFilename.empty() ? context.documentRoot + scriptName : context.scriptFilename },
+    };
+
+    if (!pathInfo.empty())
+    {
+        params.push_back({ "PATH_TRANSLATED", context.documentRoot + pathInfo });
+    }
+
+    if (request.contentLength > 0)
+    {
+        params.push_back({ "CONTENT_LENGTH", std::to_string(request.contentLength) });
+    }
+
+    for (auto const& header : request.headers)
+    {
+        if (isHeader(header.first, "Content-Type"))
+        {
+            params.push_back({ "CONTENT_TYPE", header.second });
+            continue;
+        }
+
+        // passed as CONTENT_LENGTH, hop by hop, or HTTP_PROXY (httpoxy);
+        // X_Foo would pose as X-Foo set by a proxy in front
+        if (isHeader(header.first, "Content-Length") || isHeader(header.first, "Connection")
+            || isHeader(header.first, "Proxy") || (header.first.find('_') != std::string::npos))
+        {
+            continue;
+        }
+
+        std::string name("HTTP_");
+
+        for (char c : header.first)
+        {
+            name.push_back((c == '-') ? '_' : static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+        }
+
+        auto it = std::find_if(params.begin(), params.end(), [&name] (KeyValuePair const& param) {
+            return param.first == name;
+        });
+
+        if (it == params.end())
+        {
+            params.push_back({ name, header.second });
+        }
+        else
+        {
+            it->second.append(", ").append(header.second);
+        }
+    }
+
+    return true;
+}
+
+std::string httpResponseHead(
+    KeyValuePairs const& cgiHeaders,
+    HttpRequestHead const& request,
+    bool& chunked,
+    bool& keepAlive,
+    bool& bodiless
+)
+{
+    std::string status;
+    bool hasLength(false);
+    bool hasLocation(false);
+
+    for (auto const& header : cgiHeaders)
+    {
+        status = isHeader(header.first, "Status") ? header.second : status;
+        hasLength = hasLength || isHeader(header.first, "Content-Length");
+        hasLocation = hasLocation || isHeader(header.first, "Location");
+    }
+
+    // a Location without Status is a client redirect, RFC 3875 6.2.3
+    const int code = !status.empty() ? std::atoi(status.c_str()) : (hasLocation ? 302 : 200);
+    const auto reason = status.find(' ');
+    bodiless = (request.method == "HEAD") || (code == 204) || (code == 304) || (code < 200);
+
+    chunked = !hasLength && !bodiless && (request.version == "HTTP/1.1");
+
+    // without length or chunking the end of the body is the end of the connection
+    keepAlive = keepAlive && (hasLength || chunked || bodiless);
+
+    std::string head = "HTTP/1.1 " + std::to_string(code) + " "
+        + ((reason != std::string::npos) ? trim(status.substr(reason + 1)) : std::string(httpReason(code)))
+        + CRLF;
+
+    for (auto const& header : cgiHeaders)
+    {
+        if (!isHeader(header.first, "Status") && !isHeader(header.first, "Connection")
+            && !isHeader(header.first, "Transfer-Encoding"))
+        {
+            head.append(header.first).append(": ").append(header.second).append(CRLF);
+        }
+    }
+
+    if (chunked)
+    {
+        head.append("Transfer-Encoding: chunked").append(CRLF);
+    }
+
+    head.append(keepAlive ? "Connection: keep-alive" : "Connection: close").append(CRLF);
+    head.append(CRLF);
+    return head;
+}
+
+std::string httpErrorResponse(int status, bool keepAlive)
+{
+    return "HTTP/1.1 " + std::to_string(status) + " " + httpReason(status) + CRLF
+        + "Content-Length: 0" + CRLF
+        + (keepAlive ? "Connection: keep-alive" : "Connection: close") + CRLF
+        + CRLF;
+}
+
+char const* httpReason(int status)
+{
+    switch (status)
+    {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 303: return "See Other";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 308: return "Permanent Redirect";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default: return "Unknown";
+    }
+}
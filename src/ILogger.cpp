@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ILogger.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "AsyncLogger.h"
+
+std::atomic<ILogger::Level> ILogger::s_minLevel{ ILogger::Level::INFO_LEVEL };
+
+static std::mutex gMutex;
+static std::atomic<ILogger*> gLogger{ nullptr };
+
+// owns the installed and all replaced loggers
+static std::vector<std::unique_ptr<ILogger>> gLoggers;
+
+ILogger* ILogger::getLogger()
+{
+    auto logger = gLogger.load(std::memory_order_acquire);
+
+    if (logger == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+        logger = gLogger.load(std::memory_order_relaxed);
+
+        if (logger == nullptr)
+        {
+            logger = new AsyncLogger();
+            logger->setLogLevel(s_minLevel.load(std::memory_order_relaxed));
+            gLoggers.emplace_back(logger);
+            gLogger.store(logger, std::memory_order_release);
+        }
+    }
+    return logger;
+}
+
+void ILogger::emplaceLogger(ILogger* logger)
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    // only set when none-ptr passed
+    if (logger)
+    {
+        // the macros filter on s_minLevel, the logger must agree with them
+        logger->setLogLevel(s_minLevel.load(std::memory_order_relaxed));
+        gLoggers.emplace_back(logger);
+        gLogger.store(logger, std::memory_order_release);
+    }
+}
+
+void ILogger::setLevel(Level logLevel)
+{
+    s_minLevel.store(logLevel, std::memory_order_relaxed);
+    getLogger()->setLogLevel(logLevel);
+}
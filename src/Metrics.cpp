@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// buckets exported to prometheus, in microseconds. Each is raised to the
+// upper bound of the histogram bucket holding it, so that le counts
+// every sample at or below it and nothing above
+static const uint64_t EXPORT_BOUNDS_US[] = {
+    100, 250, 500,
+    1000, 2500, 5000,
+    10000, 25000, 50000,
+    100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000,
+};
+
+static const uint64_t MAX_TRACKED_US = (1ULL << 36) - 1;
+
+static size_t shardIndex()
+{
+    static std::atomic<size_t> next{ 0 };
+
+    // threads are spread over the shards round robin on first use
+    thread_local const size_t index = next.fetch_add(1, std::memory_order_relaxed) % ShardedCounter::SHARDS;
+    return index;
+}
+
+void ShardedCounter::add(uint64_t value)
+{
+    m_shards[shardIndex()].value.fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t ShardedCounter::value() const
+{
+    uint64_t sum(0);
+
+    for (auto const& shard : m_shards)
+    {
+        sum += shard.value.load(std::memory_order_relaxed);
+    }
+
+    return sum;
+}
+
+std::chrono::microseconds HistogramSnapshot::percentile(double q) const
+{
+    if (count == 0)
+    {
+        return std::chrono::microseconds(0);
+    }
+
+    const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * count)));
+    uint64_t seen(0);
+
+    for (size_t i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets[i];
+
+        if (seen >= rank)
+        {
+            return std::chrono::microseconds(LatencyHistogram::bucketUpper(i));
+        }
+    }
+
+    return std::chrono::microseconds(MAX_TRACKED_US);
+}
+
+uint64_t HistogramSnapshot::countAtMost(std::chrono::microseconds bound) const
+{
+    uint64_t seen(0);
+
+    for (size_t i = 0; i < buckets.size(); ++i)
+    {
+        if (LatencyHistogram::bucketUpper(i) > static_cast<uint64_t>(bound.count()))
+        {
+            break;
+        }
+
+        seen += buckets[i];
+    }
+
+    return seen;
+}
+
+LatencyHistogram::Shard::Shard()
+{
+    for (auto& bucket : buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t us)
+{
+    us = std::min(us, MAX_TRACKED_US);
+
+    if (us < SUB_BUCKETS)
+    {
+        return static_cast<size_t>(us);
+    }
+
+    // exponent of the leading bit, the next 4 bits pick the sub bucket
+    const size_t exponent = 63 - __builtin_clzll(us);
+    const size_t sub = static_cast<size_t>(us >> (exponent - 4)) & (SUB_BUCKETS - 1);
+    return (exponent - 3) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpper(size_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    const size_t exponent = bucket / SUB_BUCKETS + 3;
+    const uint64_t sub = bucket % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub + 1) << (exponent - 4)) - 1;
+}
+
+void LatencyHistogram::record(std::chrono::microseconds latency)
+{
+    const auto us = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+    auto& shard = m_shards[shardIndex()];
+
+    shard.count.fetch_add(1, std::memory_order_relaxed);
+    shard.sumUs.fetch_add(us, std::memory_order_relaxed);
+    shard.buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const
+{
+    HistogramSnapshot snap;
+    snap.buckets.assign(BUCKETS, 0);
+
+    for (auto const& shard : m_shards)
+    {
+        snap.count += shard.count.load(std::memory_order_relaxed);
+        snap.sumUs += shard.sumUs.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i < BUCKETS; ++i)
+        {
+            snap.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    return snap;
+}
+
+std::shared_ptr<EndpointMetrics> Metrics::endpoint(std::string const& endpoint)
+{
+    std::lock_guard<std::mutex> lock(m_sync);
+    auto& metrics = m_endpoints[endpoint];
+
+    if (!metrics)
+    {
+        metrics = std::make_shared<EndpointMetrics>();
+    }
+
+    return metrics;
+}
+
+std::vector<EndpointSnapshot> Metrics::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(m_sync);
+    std::vector<EndpointSnapshot> snap;
+
+    for (auto const& entry : m_endpoints)
+    {
+        auto const& metrics = *entry.second;
+        EndpointSnapshot endpoint;
+
+        endpoint.endpoint = entry.first;
+        endpoint.requests = metrics.requests.value();
+        endpoint.failures = metrics.failures.value();
+        endpoint.timeouts = metrics.timeouts.value();
+        endpoint.closed = metrics.closed.value();
+        endpoint.connects = metrics.connects.value();
+        endpoint.connectFailures = metrics.connectFailures.value();
+        endpoint.staleConnections = metrics.staleConnections.value();
+        endpoint.bytesSent = metrics.bytesSent.value();
+        endpoint.bytesReceived = metrics.bytesReceived.value();
+        endpoint.total = metrics.total.snapshot();
+        endpoint.connect = metrics.connect.snapshot();
+        endpoint.firstByte = metrics.firstByte.snapshot();
+        endpoint.server = metrics.server.snapshot();
+        snap.push_back(std::move(endpoint));
+    }
+
+    return snap;
+}
+
+static void appendHeader(std::string& out, const char* name, const char* type, const char* help)
+{
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+static void appendCounter(
+    std::string& out,
+    std::vector<EndpointSnapshot> const& snapshot,
+    const char* name,
+    const char* help,
+    uint64_t EndpointSnapshot::* field
+)
+{
+    appendHeader(out, name, "counter", help);
+
+    for (auto const& endpoint : snapshot)
+    {
+        out.append(name).append("{endpoint=\"").append(endpoint.endpoint).append("\"} ");
+        out.append(std::to_string(endpoint.*field)).append("\n");
+    }
+}
+
+static void appendHistogram(
+    std::string& out,
+    std::vector<EndpointSnapshot> const& snapshot,
+    const char* name,
+    const char* help,
+    HistogramSnapshot EndpointSnapshot::* field
+)
+{
+    char value[32];
+
+    appendHeader(out, name, "histogram", help);
+
+    for (auto const& endpoint : snapshot)
+    {
+        auto const& hist = endpoint.*field;
+        const auto label = "{endpoint=\"" + endpoint.endpoint + "\"";
+
+        for (auto nominal : EXPORT_BOUNDS_US)
+        {
+            const auto bound = LatencyHistogram::bucketUpper(LatencyHistogram::bucketOf(nominal));
+
+            std::snprintf(value, sizeof(value), "%.6f", bound / 1e6);
+            out.append(name).append("_bucket").append(label).append(",le=\"").append(value).append("\"} ");
+            out.append(std::to_string(hist.countAtMost(std::chrono::microseconds(bound)))).append("\n");
+        }
+
+        out.append(name).append("_bucket").append(label).append(",le=\"+Inf\"} ");
+        out.append(std::to_string(hist.count)).append("\n");
+
+        std::snprintf(value, sizeof(value), "%.6f", hist.sumUs / 1e6);
+        out.append(name).append("_sum").append(label).append("} ").append(value).append("\n");
+        out.append(name).append("_count").append(label).append("} ");
+        out.append(std::to_string(hist.count)).append("\n");
+    }
+}
+
+std::string Metrics::toPrometheus(std::vector<EndpointSnapshot> const& snapshot)
+{
+    std::string out;
+
+    appendCounter(out, snapshot, "fcgi_client_requests_total",
+        "Requests sent.", &EndpointSnapshot::requests);
+    appendCounter(out, snapshot, "fcgi_client_failures_total",
+        "Requests failed on transport errors.", &EndpointSnapshot::failures);
+    appendCounter(out, snapshot, "fcgi_client_timeouts_total",
+        "Requests timed out.", &EndpointSnapshot::timeouts);
+    appendCounter(out, snapshot, "fcgi_client_closed_total",
+        "Requests failed on closed connections.", &EndpointSnapshot::closed);
+    appendCounter(out, snapshot, "fcgi_client_connects_total",
+        "Connections opened.", &EndpointSnapshot::connects);
+    appendCounter(out, snapshot, "fcgi_client_connect_failures_total",
+        "Connections failed to open.", &EndpointSnapshot::connectFailures);
+    appendCounter(out, snapshot, "fcgi_client_stale_connections_total",
+        "Idle connections found closed by the server.", &EndpointSnapshot::staleConnections);
+    appendCounter(out, snapshot, "fcgi_client_sent_bytes_total",
+        "Request bytes sent.", &EndpointSnapshot::bytesSent);
+    appendCounter(out, snapshot, "fcgi_client_received_bytes_total",
+        "Response bytes received.", &EndpointSnapshot::bytesReceived);
+
+    appendHistogram(out, snapshot, "fcgi_client_request_duration_seconds",
+        "Whole request latency.", &EndpointSnapshot::total);
+    appendHistogram(out, snapshot, "fcgi_client_connect_duration_seconds",
+        "Connection open latency.", &EndpointSnapshot::connect);
+    appendHistogram(out, snapshot, "fcgi_client_first_byte_seconds",
+        "Latency until the first response record.", &EndpointSnapshot::firstByte);
+    appendHistogram(out, snapshot, "fcgi_client_server_duration_seconds",
+        "Latency from request written until request end.", &EndpointSnapshot::server);
+
+    return out;
+}
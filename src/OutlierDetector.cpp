@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "OutlierDetector.h"
+
+#include <algorithm>
+
+#include "ILogger.h"
+
+// smoothing factor of latency and error rate moving averages
+static const double EWMA_ALPHA = 0.1;
+
+// weight a re-admitted endpoint starts ramping up from
+static const double MIN_WEIGHT = 0.1;
+
+OutlierDetector::OutlierDetector(size_t endpoints, OutlierConfig const& config)
+    : m_config(config)
+    , m_stats(endpoints)
+{
+}
+
+void OutlierDetector::record(
+    size_t endpoint,
+    ReturnCode rc,
+    std::chrono::microseconds latency,
+    Clock::time_point now
+)
+{
+    if (isEjected(endpoint, now))
+    {
+        // late result of a request issued before ejection
+        return;
+    }
+
+    auto& stats = m_stats[endpoint];
+    const bool failed = (rc != ReturnCode::OK);
+    const double sample = static_cast<double>(latency.count());
+
+    if (stats.samples == 0)
+    {
+        stats.latencyUs = sample;
+        stats.errorRate = failed ? 1.0 : 0.0;
+    }
+    else
+    {
+        stats.latencyUs += EWMA_ALPHA * (sample - stats.latencyUs);
+        stats.errorRate += EWMA_ALPHA * ((failed ? 1.0 : 0.0) - stats.errorRate);
+    }
+
+    ++stats.samples;
+    stats.consecutiveErrors = failed ? stats.consecutiveErrors + 1 : 0;
+
+    if (stats.consecutiveErrors >= m_config.consecutiveErrors)
+    {
+        eject(endpoint, now);
+    }
+    else if (stats.samples >= m_config.minSamples)
+    {
+        if ((stats.errorRate > m_config.maxErrorRate) || isLatencyOutlier(endpoint))
+        {
+            eject(endpoint, now);
+        }
+    }
+}
+
+bool OutlierDetector::isEjected(size_t endpoint, Clock::time_point now) const
+{
+    return m_stats[endpoint].ejectedUntil > now;
+}
+
+double OutlierDetector::weight(size_t endpoint, Clock::time_point now) const
+{
+    auto const& stats = m_stats[endpoint];
+
+    if (stats.ejections == 0)
+    {
+        return 1.0;
+    }
+
+    if (stats.ejectedUntil > now)
+    {
+        return 0.0;
+    }
+
+    const auto readmitted = now - stats.ejectedUntil;
+
+    if ((m_config.rampUp.count() <= 0) || (readmitted >= m_config.rampUp))
+    {
+        return 1.0;
+    }
+
+    const double ratio =
+        std::chrono::duration<double>(readmitted).count() /
+        std::chrono::duration<double>(m_config.rampUp).count();
+
+    return std::max(MIN_WEIGHT, ratio);
+}
+
+double OutlierDetector::latency(size_t endpoint) const
+{
+    return m_stats[endpoint].latencyUs;
+}
+
+bool OutlierDetector::isLatencyOutlier(size_t endpoint) const
+{
+    std::vector<double> peers;
+
+    for (size_t i = 0; i < m_stats.size(); ++i)
+    {
+        // ejected endpoints restart with no samples, so they are skipped too
+        if ((i != endpoint) && (m_stats[i].samples >= m_config.minSamples))
+        {
+            peers.push_back(m_stats[i].latencyUs);
+        }
+    }
+
+    if (peers.empty())
+    {
+        return false;
+    }
+
+    auto median = peers.begin() + peers.size() / 2;
+    std::nth_element(peers.begin(), median, peers.end());
+
+    return (*median > 0.0) &&
+        (m_stats[endpoint].latencyUs > m_config.latencyFactor * (*median));
+}
+
+size_t OutlierDetector::ejectedCount(Clock::time_point now) const
+{
+    return std::count_if(m_stats.begin(), m_stats.end(), [&] (auto const& stats) {
+        return stats.ejectedUntil > now;
+    });
+}
+
+void OutlierDetector::eject(size_t endpoint, Clock::time_point now)
+{
+    const auto allowed = m_stats.size() * m_config.maxEjectionPercent / 100;
+
+    if (ejectedCount(now) + 1 > allowed)
+    {
+        DEBUG("endpoint (=%zu) is an outlier, but ejection limit reached.", endpoint);
+        return;
+    }
+
+    auto& stats = m_stats[endpoint];
+
+    if ((stats.ejections > 0) && (now - stats.ejectedUntil > m_config.maxEjection))
+    {
+        // behaved well for long enough, restart the backoff
+        stats.ejections = 0;
+    }
+
+    auto period = m_config.baseEjection;
+
+    for (uint32_t i = 0; (i < stats.ejections) && (period < m_config.maxEjection); ++i)
+    {
+        period *= 2;
+    }
+
+    period = std::min(period, m_config.maxEjection);
+
+    WARN(
+        "eject endpoint (=%zu) for %lld ms, latency (=%.0f us), error rate (=%.2f).",
+        endpoint,
+        static_cast<long long>(period.count()),
+        stats.latencyUs,
+        stats.errorRate
+    );
+
+    ++stats.ejections;
+    stats.ejectedUntil = now + period;
+
+    // judge the endpoint on fresh samples once it is re-admitted
+    stats.latencyUs = 0.0;
+    stats.errorRate = 0.0;
+    stats.samples = 0;
+    stats.consecutiveErrors = 0;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ParamsBuilder.h"
+
+#include <algorithm>
+
+#include "FcgiCodec.h"
+
+// record type of FCGI_PARAMS
+static const uint8_t PARAMS_RECORD = 4;
+
+// lengths below this take one byte, longer ones four
+static const size_t SHORT_LENGTH_LIMIT = 128;
+
+static size_t lengthSize(size_t len)
+{
+    return (len < SHORT_LENGTH_LIMIT) ? 1 : 4;
+}
+
+static char* encodeLength(char* out, size_t len)
+{
+    if (len < SHORT_LENGTH_LIMIT)
+    {
+        *out++ = static_cast<char>(len);
+        return out;
+    }
+
+    *out++ = static_cast<char>(((len >> 24) & 0x7F) | 0x80);
+    *out++ = static_cast<char>((len >> 16) & 0xFF);
+    *out++ = static_cast<char>((len >> 8) & 0xFF);
+    *out++ = static_cast<char>(len & 0xFF);
+    return out;
+}
+
+static const unsigned char* decodeLength(const unsigned char* in, size_t& len)
+{
+    if (*in < SHORT_LENGTH_LIMIT)
+    {
+        len = *in++;
+        return in;
+    }
+
+    len = (static_cast<size_t>(in[0] & 0x7F) << 24) | (static_cast<size_t>(in[1]) << 16)
+        | (static_cast<size_t>(in[2]) << 8) | in[3];
+    return in + 4;
+}
+
+ParamsBuilder::ParamsBuilder(ParamsBuilder const& other)
+{
+    *this = other;
+}
+
+ParamsBuilder& ParamsBuilder::operator=(ParamsBuilder const& other)
+{
+    if (this != &other)
+    {
+        // only the used part of the inline buffer is worth copying
+        m_size = 0;
+        m_count = other.m_count;
+        std::memcpy(reserve(other.m_size), other.data(), other.m_size);
+        m_size = other.m_size;
+    }
+
+    return *this;
+}
+
+ParamsBuilder& ParamsBuilder::add(ParamRef name, ParamRef value)
+{
+    if (name.size == 0)
+    {
+        return *this;
+    }
+
+    auto out = reserve(lengthSize(name.size) + lengthSize(value.size) + name.size + value.size);
+    const auto begin = out;
+
+    out = encodeLength(out, name.size);
+    out = encodeLength(out, value.size);
+    std::memcpy(out, name.data, name.size);
+    out += name.size;
+    std::memcpy(out, value.data, value.size);
+    out += value.size;
+
+    m_size += out - begin;
+    ++m_count;
+    return *this;
+}
+
+ParamsBuilder& ParamsBuilder::add(ParamRef name, int64_t value)
+{
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* pos = end;
+    auto magnitude = (value < 0) ? (0 - static_cast<uint64_t>(value)) : static_cast<uint64_t>(value);
+
+    do
+    {
+        *--pos = static_cast<char>('0' + (magnitude % 10));
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    if (value < 0)
+    {
+        *--pos = '-';
+    }
+
+    return add(name, ParamRef(pos, end - pos));
+}
+
+ParamsBuilder& ParamsBuilder::add(KeyValuePairs const& pairs)
+{
+    for (auto const& pair : pairs)
+    {
+        add(pair.first, pair.second);
+    }
+
+    return *this;
+}
+
+bool ParamsBuilder::find(ParamRef name, ParamRef& value) const
+{
+    auto in = reinterpret_cast<const unsigned char*>(data());
+    const auto end = in + m_size;
+
+    while (in < end)
+    {
+        size_t nameLen;
+        size_t valueLen;
+
+        in = decodeLength(in, nameLen);
+        in = decodeLength(in, valueLen);
+
+        if ((nameLen == name.size) && (std::memcmp(in, name.data, nameLen) == 0))
+        {
+            value = ParamRef(reinterpret_cast<const char*>(in) + nameLen, valueLen);
+            return true;
+        }
+
+        in += nameLen + valueLen;
+    }
+
+    return false;
+}
+
+bool ParamsBuilder::contains(ParamRef name) const
+{
+    ParamRef value(nullptr, 0);
+    return find(name, value);
+}
+
+size_t ParamsBuilder::count() const
+{
+    return m_count;
+}
+
+const char* ParamsBuilder::data() const
+{
+    return m_heap.empty() ? m_inline : m_heap.data();
+}
+
+size_t ParamsBuilder::size() const
+{
+    return m_size;
+}
+
+size_t ParamsBuilder::recordsSize() const
+{
+    const auto records = (m_size + FCGI_MAX_CONTENT - 1) / FCGI_MAX_CONTENT;
+    return m_size + records * FCGI_HEADER_SIZE;
+}
+
+void ParamsBuilder::appendRecords(std::string& out, uint16_t requestId) const
+{
+    const auto params = data();
+    char hdr[FCGI_HEADER_SIZE];
+
+    out.reserve(out.size() + recordsSize());
+
+    // a record carries at most 64k - 1 bytes of content
+    for (size_t pos = 0; pos < m_size; pos += FCGI_MAX_CONTENT)
+    {
+        const auto len = std::min(FCGI_MAX_CONTENT, m_size - pos);
+
+        encodeFastCgiHeader(hdr, PARAMS_RECORD, requestId, len);
+        out.append(hdr, sizeof(hdr));
+        out.append(params + pos, len);
+    }
+}
+
+void ParamsBuilder::clear()
+{
+    // a spilled builder keeps its heap buffer for reuse
+    m_size = 0;
+    m_count = 0;
+}
+
+char* ParamsBuilder::reserve(size_t len)
+{
+    const auto capacity = m_heap.empty() ? INLINE_CAPACITY : m_heap.size();
+
+    if (m_size + len > capacity)
+    {
+        const auto spill = m_heap.empty();
+
+        m_heap.resize(std::max(capacity * 2, m_size + len));
+
+        if (spill)
+        {
+            std::memcpy(m_heap.data(), m_inline, m_size);
+        }
+    }
+
+    return (m_heap.empty() ? m_inline : m_heap.data()) + m_size;
+}
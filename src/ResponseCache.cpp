@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ResponseCache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+
+#include "CgiHeaders.h"
+#include "Fingerprint.h"
+
+static const std::string CACHE_CONTROL_TOKEN("Cache-Control");
+static const std::string EXPIRES_TOKEN("Expires");
+
+static const std::string MAX_AGE_TOKEN("max-age=");
+static const std::string S_MAXAGE_TOKEN("s-maxage=");
+static const std::string SWR_TOKEN("stale-while-revalidate=");
+
+static std::string toLower(std::string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(), [] (unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    return str;
+}
+
+static bool startsWith(std::string const& str, std::string const& prefix)
+{
+    return str.compare(0, prefix.length(), prefix) == 0;
+}
+
+static bool parseHttpDate(std::string const& value, std::chrono::system_clock::time_point& when)
+{
+    struct tm tm = {};
+
+    if (strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm) == nullptr)
+    {
+        return false;
+    }
+
+    when = std::chrono::system_clock::from_time_t(timegm(&tm));
+    return true;
+}
+
+ResponseCache::ResponseCache(CacheConfig const& config)
+    : m_config(config)
+{
+    const auto shards = std::max<size_t>(m_config.shards, 1);
+    m_shardBytes = m_config.maxBytes / shards;
+
+    for (size_t i = 0; i < shards; ++i)
+    {
+        m_shards.emplace_back(new Shard());
+    }
+}
+
+bool ResponseCache::isEnabled() const
+{
+    return m_config.enabled;
+}
+
+bool ResponseCache::key(KeyValuePairs const& pairs, std::string& cacheKey) const
+{
+    return paramsKey(pairs, m_config.keyParams, cacheKey);
+}
+
+ResponseCache::Freshness ResponseCache::lookup(
+    std::string const& key,
+    std::shared_ptr<const std::string>& response,
+    Clock::time_point now
+)
+{
+    auto& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.sync);
+    auto found = shard.index.find(key);
+
+    if (found == shard.index.end())
+    {
+        return Freshness::MISS;
+    }
+
+    auto entry = found->second;
+
+    if (now >= entry->staleUntil)
+    {
+        erase(shard, entry);
+        return Freshness::MISS;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+    response = entry->response;
+
+    return (now < entry->freshUntil) ? Freshness::FRESH : Freshness::STALE;
+}
+
+void ResponseCache::store(
+    std::string const& key,
+    std::shared_ptr<const std::string> const& response,
+    Clock::time_point now
+)
+{
+    auto& shard = shardOf(key);
+    std::chrono::seconds ttl;
+    std::chrono::seconds staleTtl;
+    const auto cacheable = response && parsePolicy(*response, m_config.defaultTtl, ttl, staleTtl);
+    const auto size = cacheable ? key.length() + response->length() + sizeof(Entry) : 0;
+
+    std::lock_guard<std::mutex> lock(shard.sync);
+    auto found = shard.index.find(key);
+
+    if (found != shard.index.end())
+    {
+        erase(shard, found->second);
+    }
+
+    if (!cacheable || (size > m_shardBytes))
+    {
+        return;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.response = response;
+    entry.freshUntil = now + ttl;
+    entry.staleUntil = entry.freshUntil + staleTtl;
+
+    shard.lru.push_front(std::move(entry));
+    shard.index[key] = shard.lru.begin();
+    shard.bytes += size;
+
+    while (shard.bytes > m_shardBytes)
+    {
+        erase(shard, std::prev(shard.lru.end()));
+    }
+}
+
+bool ResponseCache::beginRefresh(std::string const& key)
+{
+    auto& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.sync);
+    auto found = shard.index.find(key);
+
+    if ((found == shard.index.end()) || found->second->refreshing)
+    {
+        return false;
+    }
+
+    found->second->refreshing = true;
+    return true;
+}
+
+void ResponseCache::abandonRefresh(std::string const& key)
+{
+    auto& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.sync);
+    auto found = shard.index.find(key);
+
+    if (found != shard.index.end())
+    {
+        found->second->refreshing = false;
+    }
+}
+
+bool ResponseCache::parsePolicy(
+    std::string const& response,
+    std::chrono::seconds defaultTtl,
+    std::chrono::seconds& ttl,
+    std::chrono::seconds& staleTtl
+)
+{
+    KeyValuePairs headers;
+    size_t bodyOffset;
+
+    // only plain successful responses are cached
+    if (!parseCgiHeaders(response, headers, bodyOffset) || (cgiStatus(headers) != 200))
+    {
+        return false;
+    }
+
+    long maxAge(-1);
+    long sharedMaxAge(-1);
+    long expires(-1);
+    long staleWhileRevalidate(0);
+
+    for (auto const& header : headers)
+    {
+        if (isHeader(header.first, CACHE_CONTROL_TOKEN))
+        {
+            const auto directives = toLower(header.second);
+            size_t start(0);
+
+            while (start <= directives.length())
+            {
+                auto comma = directives.find(',', start);
+
+                if (comma == std::string::npos)
+                {
+                    comma = directives.length();
+                }
+
+                const auto directive = trim(directives.substr(start, comma - start));
+                start = comma + 1;
+
+                if ((directive == "no-store") || (directive == "no-cache") ||
+                    (directive == "private"))
+                {
+                    return false;
+                }
+                else if (startsWith(directive, MAX_AGE_TOKEN))
+                {
+                    maxAge = std::atol(directive.c_str() + MAX_AGE_TOKEN.length());
+                }
+                else if (startsWith(directive, S_MAXAGE_TOKEN))
+                {
+                    sharedMaxAge = std::atol(directive.c_str() + S_MAXAGE_TOKEN.length());
+                }
+                else if (startsWith(directive, SWR_TOKEN))
+                {
+                    staleWhileRevalidate = std::atol(directive.c_str() + SWR_TOKEN.length());
+                }
+            }
+        }
+        else if (isHeader(header.first, EXPIRES_TOKEN))
+        {
+            std::chrono::system_clock::time_point when;
+
+            // an invalid date means already expired
+            expires = 0;
+
+            if (parseHttpDate(header.second, when))
+            {
+                expires = std::max<long>(0, static_cast<long>(
+                    std::chrono::duration_cast<std::chrono::seconds>(
+                        when - std::chrono::system_clock::now()
+                    ).count()
+                ));
+            }
+        }
+    }
+
+    if (sharedMaxAge >= 0)
+    {
+        ttl = std::chrono::seconds(sharedMaxAge);
+    }
+    else if (maxAge >= 0)
+    {
+        ttl = std::chrono::seconds(maxAge);
+    }
+    else if (expires >= 0)
+    {
+        ttl = std::chrono::seconds(expires);
+    }
+    else
+    {
+        ttl = defaultTtl;
+    }
+
+    staleTtl = std::chrono::seconds(std::max<long>(0, staleWhileRevalidate));
+    return ttl.count() > 0;
+}
+
+ResponseCache::Shard& ResponseCache::shardOf(std::string const& key)
+{
+    return *m_shards[std::hash<std::string>()(key) % m_shards.size()];
+}
+
+void ResponseCache::erase(Shard& shard, std::list<Entry>::iterator entry)
+{
+    shard.bytes -= entry->key.length() + entry->response->length() + sizeof(Entry);
+    shard.index.erase(entry->key);
+    shard.lru.erase(entry);
+}
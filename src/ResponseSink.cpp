@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ResponseSink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ILogger.h"
+
+MemoryBudget::MemoryBudget(size_t limit)
+    : m_limit(limit)
+{
+}
+
+bool MemoryBudget::reserve(size_t bytes)
+{
+    auto used = m_used.load(std::memory_order_relaxed);
+
+    do
+    {
+        if ((bytes > m_limit) || (used > m_limit - bytes))
+        {
+            return false;
+        }
+    } while (!m_used.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+
+    return true;
+}
+
+void MemoryBudget::release(size_t bytes)
+{
+    m_used.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+size_t MemoryBudget::used() const
+{
+    return m_used.load(std::memory_order_relaxed);
+}
+
+ResponseSink::ResponseSink(SinkConfig const& config, std::shared_ptr<MemoryBudget> const& budget)
+    : m_config(config)
+    , m_budget(budget)
+{
+}
+
+ResponseSink::~ResponseSink()
+{
+    clear();
+}
+
+bool ResponseSink::append(const char* data, size_t len)
+{
+    if (len == 0)
+    {
+        return true;
+    }
+
+    if (m_config.consumer)
+    {
+        m_size += len;
+        return m_config.consumer(data, len);
+    }
+
+    unmap();
+
+    if (m_fd < 0)
+    {
+        if ((len <= m_config.memoryLimit - std::min(m_size, m_config.memoryLimit))
+            && (!m_budget || m_budget->reserve(len)))
+        {
+            m_memory.append(data, len);
+            m_reserved += m_budget ? len : 0;
+            m_size += len;
+            return true;
+        }
+
+        if (!m_config.spill)
+        {
+            m_overLimit = true;
+            return false;
+        }
+
+        if (!spill())
+        {
+            return false;
+        }
+    }
+
+    if (!writeFile(data, len))
+    {
+        return false;
+    }
+
+    m_size += len;
+    return true;
+}
+
+void ResponseSink::clear()
+{
+    unmap();
+
+    if (m_budget && (m_reserved > 0))
+    {
+        m_budget->release(m_reserved);
+    }
+
+    // give the memory back, budgets count it as released
+    std::string().swap(m_memory);
+    m_reserved = 0;
+    m_size = 0;
+    m_overLimit = false;
+
+    if ((m_fd >= 0) && (m_config.spillFd < 0))
+    {
+        ::close(m_fd);
+    }
+
+    m_fd = -1;
+    m_base = 0;
+}
+
+size_t ResponseSink::size() const
+{
+    return m_size;
+}
+
+bool ResponseSink::isSpilled() const
+{
+    return m_fd >= 0;
+}
+
+bool ResponseSink::isOverLimit() const
+{
+    return m_overLimit;
+}
+
+std::string const& ResponseSink::memory() const
+{
+    return m_memory;
+}
+
+bool ResponseSink::view(const char*& data, size_t& len)
+{
+    if (!isSpilled() || (m_size == 0))
+    {
+        data = m_memory.data();
+        len = m_size;
+        return true;
+    }
+
+    if (m_map == nullptr)
+    {
+        // mappings start on a page boundary, caller descriptors may not
+        const auto page = static_cast<off_t>(::sysconf(_SC_PAGESIZE));
+        const auto aligned = m_base - m_base % page;
+        const auto mapLen = m_size + static_cast<size_t>(m_base - aligned);
+        auto map = ::mmap(nullptr, mapLen, PROT_READ, MAP_SHARED, m_fd, aligned);
+
+        if (map == MAP_FAILED)
+        {
+            WARN("mmap response failed, error (=%s).", std::strerror(errno));
+            return false;
+        }
+
+        m_map = map;
+        m_mapLen = mapLen;
+    }
+
+    data = static_cast<const char*>(m_map) + (m_mapLen - m_size);
+    len = m_size;
+    return true;
+}
+
+size_t ResponseSink::read(size_t offset, char* buf, size_t len) const
+{
+    if (offset >= m_size)
+    {
+        return 0;
+    }
+
+    len = std::min(len, m_size - offset);
+
+    if (!isSpilled())
+    {
+        std::memcpy(buf, m_memory.data() + offset, len);
+        return len;
+    }
+
+    while (true)
+    {
+        const auto got = ::pread(m_fd, buf, len, m_base + static_cast<off_t>(offset));
+
+        if (got >= 0)
+        {
+            return static_cast<size_t>(got);
+        }
+
+        if (errno != EINTR)
+        {
+            WARN("read response failed, error (=%s).", std::strerror(errno));
+            return 0;
+        }
+    }
+}
+
+bool ResponseSink::take(std::string& out)
+{
+    if (!isSpilled())
+    {
+        out.swap(m_memory);
+        clear();
+        return true;
+    }
+
+    out.resize(m_size);
+    size_t pos(0);
+
+    while (pos < m_size)
+    {
+        const auto got = read(pos, &out[pos], m_size - pos);
+
+        if (got == 0)
+        {
+            out.clear();
+            clear();
+            return false;
+        }
+
+        pos += got;
+    }
+
+    clear();
+    return true;
+}
+
+bool ResponseSink::spill()
+{
+    if (m_config.spillFd >= 0)
+    {
+        m_fd = m_config.spillFd;
+        m_base = std::max<off_t>(::lseek(m_fd, 0, SEEK_CUR), 0);
+    }
+    else
+    {
+#if defined(O_TMPFILE)
+        m_fd = ::open(m_config.spillDir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+
+        if (m_fd < 0)
+        {
+            // no O_TMPFILE support, unlink right after creation instead
+            auto path = m_config.spillDir + "/fcgi-response-XXXXXX";
+            m_fd = ::mkstemp(&path[0]);
+
+            if (m_fd >= 0)
+            {
+                ::unlink(path.c_str());
+            }
+        }
+
+        m_base = 0;
+    }
+
+    if (m_fd < 0)
+    {
+        WARN("create spill file failed, error (=%s).", std::strerror(errno));
+        return false;
+    }
+
+    DEBUG("response of %zu bytes spilled to file.", m_size);
+
+    if (!writeFile(m_memory.data(), m_memory.size()))
+    {
+        if (m_config.spillFd < 0)
+        {
+            ::close(m_fd);
+        }
+
+        m_fd = -1;
+        return false;
+    }
+
+    std::string().swap(m_memory);
+
+    if (m_budget && (m_reserved > 0))
+    {
+        m_budget->release(m_reserved);
+    }
+
+    m_reserved = 0;
+    return true;
+}
+
+bool ResponseSink::writeFile(const char* data, size_t len)
+{
+    while (len > 0)
+    {
+        const auto written = ::write(m_fd, data, len);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            WARN("write spill file failed, error (=%s).", std::strerror(errno));
+            return false;
+        }
+
+        data += written;
+        len -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+void ResponseSink::unmap()
+{
+    if (m_map != nullptr)
+    {
+        ::munmap(m_map, m_mapLen);
+        m_map = nullptr;
+        m_mapLen = 0;
+    }
+}
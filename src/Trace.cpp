@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <limits>
+
+#include "Fingerprint.h"
+#include "ILogger.h"
+
+// fnv leaves the high bits of similar ids alike, spread them before sampling
+static uint64_t mix(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+int64_t TraceSpan::elapsedUs(Clock::time_point begin, Clock::time_point end)
+{
+    if ((begin == Clock::time_point()) || (end == Clock::time_point()))
+    {
+        return -1;
+    }
+
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+}
+
+void LogSpanExporter::exportSpan(TraceSpan const& span)
+{
+    INFO(
+        "trace (=%s) endpoint (=%s) request (=%u) status (=%d) queue (=%" PRId64 " us) "
+        "encode (=%" PRId64 " us) write (=%" PRId64 " us) first stdout (=%" PRId64 " us) "
+        "end (=%" PRId64 " us) total (=%" PRId64 " us).",
+        span.traceId.c_str(),
+        span.endpoint.c_str(),
+        static_cast<unsigned>(span.requestId),
+        static_cast<int>(span.status),
+        TraceSpan::elapsedUs(span.entered, span.acquired),
+        TraceSpan::elapsedUs(span.acquired, span.encoded),
+        TraceSpan::elapsedUs(span.encoded, span.written),
+        TraceSpan::elapsedUs(span.written, span.firstStdout),
+        TraceSpan::elapsedUs(span.written, span.ended),
+        TraceSpan::elapsedUs(span.entered, span.ended)
+    );
+}
+
+Tracer::Tracer(std::shared_ptr<ISpanExporter> const& exporter, TracerConfig const& config)
+    : m_exporter(exporter)
+    , m_config(config)
+{
+    const auto rate = std::min(std::max(config.sampleRate, 0.0), 1.0);
+
+    // ids hashing below the threshold are traced
+    m_threshold = (rate >= 1.0)
+        ? std::numeric_limits<uint64_t>::max()
+        : static_cast<uint64_t>(rate * static_cast<double>(std::numeric_limits<uint64_t>::max()));
+}
+
+bool Tracer::begin(ParamsBuilder const& params, TraceSpan& span) const
+{
+    if (!m_exporter || (m_threshold == 0))
+    {
+        return false;
+    }
+
+    ParamRef value(nullptr, 0);
+
+    if (!params.find(m_config.traceParam, value) || (value.size == 0))
+    {
+        return false;
+    }
+
+    std::string traceId(value.data, value.size);
+
+    if ((m_threshold != std::numeric_limits<uint64_t>::max())
+        && (mix(fingerprint(traceId)) > m_threshold))
+    {
+        return false;
+    }
+
+    span.traceId = std::move(traceId);
+    return true;
+}
+
+void Tracer::finish(TraceSpan const& span) const
+{
+    m_exporter->exportSpan(span);
+}
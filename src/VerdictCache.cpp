@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "VerdictCache.h"
+
+#include "CgiHeaders.h"
+#include "Fingerprint.h"
+
+static const std::string VARIABLE_PREFIX("Variable-");
+
+bool AuthorizerVerdict::parse(std::string const& authorizerResponse)
+{
+    KeyValuePairs headers;
+    size_t bodyOffset;
+
+    authorized = false;
+    variables.clear();
+    response = authorizerResponse;
+
+    if (!parseCgiHeaders(authorizerResponse, headers, bodyOffset))
+    {
+        status = 0;
+        return false;
+    }
+
+    status = cgiStatus(headers);
+    authorized = (status == 200);
+
+    for (auto const& header : headers)
+    {
+        if ((header.first.length() > VARIABLE_PREFIX.length()) &&
+            isHeader(header.first.substr(0, VARIABLE_PREFIX.length()), VARIABLE_PREFIX))
+        {
+            variables.push_back({ header.first.substr(VARIABLE_PREFIX.length()), header.second });
+        }
+    }
+
+    return true;
+}
+
+VerdictCache::VerdictCache(VerdictCacheConfig const& config)
+    : m_config(config)
+{
+}
+
+bool VerdictCache::key(KeyValuePairs const& pairs, std::string& cacheKey) const
+{
+    return paramsKey(pairs, m_config.keyParams, cacheKey);
+}
+
+bool VerdictCache::lookup(
+    std::string const& cacheKey,
+    AuthorizerVerdict& verdict,
+    Clock::time_point now
+)
+{
+    std::lock_guard<std::mutex> lock(m_sync);
+    auto found = m_index.find(cacheKey);
+
+    if (found == m_index.end())
+    {
+        return false;
+    }
+
+    auto entry = found->second;
+
+    if (now >= entry->expire)
+    {
+        m_index.erase(found);
+        m_lru.erase(entry);
+        return false;
+    }
+
+    m_lru.splice(m_lru.begin(), m_lru, entry);
+    verdict = entry->verdict;
+    return true;
+}
+
+void VerdictCache::store(
+    std::string const& cacheKey,
+    AuthorizerVerdict const& verdict,
+    Clock::time_point now
+)
+{
+    // only a grant or an explicit denial speaks for the credentials,
+    // any other status is an authorizer failure and must be asked again
+    if (!verdict.authorized && (verdict.status != 401) && (verdict.status != 403))
+    {
+        return;
+    }
+
+    const auto ttl = verdict.authorized ? m_config.allowTtl : m_config.denyTtl;
+
+    if ((ttl.count() <= 0) || (m_config.maxEntries == 0))
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_sync);
+    auto found = m_index.find(cacheKey);
+
+    if (found != m_index.end())
+    {
+        m_lru.erase(found->second);
+        m_index.erase(found);
+    }
+
+    m_lru.push_front(Entry{ cacheKey, verdict, now + ttl });
+    m_index[cacheKey] = m_lru.begin();
+
+    while (m_lru.size() > m_config.maxEntries)
+    {
+        m_index.erase(m_lru.back().key);
+        m_lru.pop_back();
+    }
+}
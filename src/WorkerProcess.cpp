@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "WorkerProcess.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ILogger.h"
+
+extern char** environ;
+
+static const int LISTEN_BACKLOG = 64;
+static const auto REAP_INTERVAL = std::chrono::milliseconds(5);
+
+WorkerProcess::WorkerProcess(
+    std::vector<std::string> const& command,
+    std::vector<std::string> const& environment,
+    std::string const& socketPath
+)
+    : m_command(command)
+    , m_environment(environment)
+    , m_socketPath(socketPath)
+{
+}
+
+WorkerProcess::~WorkerProcess()
+{
+    terminate(std::chrono::milliseconds(1000));
+}
+
+bool WorkerProcess::spawn()
+{
+    struct sockaddr_un addr = {};
+
+    if (m_command.empty() || (m_socketPath.size() >= sizeof(addr.sun_path)))
+    {
+        WARN("invalid worker command or socket path (=%s).", m_socketPath.c_str());
+        return false;
+    }
+
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, m_socketPath.c_str(), m_socketPath.size() + 1);
+    ::unlink(m_socketPath.c_str());
+
+    const int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if ((listener < 0)
+        || (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        || (::listen(listener, LISTEN_BACKLOG) != 0))
+    {
+        WARN("listen on (=%s) failed, error (=%s).", m_socketPath.c_str(), std::strerror(errno));
+
+        if (listener >= 0)
+        {
+            ::close(listener);
+        }
+        return false;
+    }
+
+    std::vector<char*> argv;
+    std::vector<char*> envp;
+
+    for (auto const& arg : m_command)
+    {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+
+    for (auto const& env : m_environment)
+    {
+        envp.push_back(const_cast<char*>(env.c_str()));
+    }
+
+    // getenv returns the first match, inherited values must not shadow
+    // the configured ones
+    for (char** env = environ; *env != nullptr; ++env)
+    {
+        const char* assign = std::strchr(*env, '=');
+        const size_t nameLen = (assign != nullptr) ? static_cast<size_t>(assign - *env) : std::strlen(*env);
+
+        const bool overridden = std::any_of(
+            m_environment.begin(),
+            m_environment.end(),
+            [env, nameLen] (std::string const& entry) {
+                return (entry.size() > nameLen) && (entry[nameLen] == '=')
+                    && (entry.compare(0, nameLen, *env, nameLen) == 0);
+            }
+        );
+
+        if (!overridden)
+        {
+            envp.push_back(*env);
+        }
+    }
+
+    argv.push_back(nullptr);
+    envp.push_back(nullptr);
+
+    // posix_spawn is safe in threaded programs, unlike fork without exec
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, listener, 0);
+
+    const int rc = ::posix_spawnp(&m_pid, argv[0], &actions, nullptr, argv.data(), envp.data());
+
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(listener);
+
+    if (rc != 0)
+    {
+        WARN("spawn worker (=%s) failed, error (=%s).", argv[0], std::strerror(rc));
+        m_pid = -1;
+        ::unlink(m_socketPath.c_str());
+        return false;
+    }
+
+    INFO("worker (=%d) started on (=%s).", static_cast<int>(m_pid), m_socketPath.c_str());
+    return true;
+}
+
+bool WorkerProcess::isRunning()
+{
+    if (m_pid <= 0)
+    {
+        return false;
+    }
+
+    int status(0);
+    pid_t reaped;
+
+    do
+    {
+        reaped = ::waitpid(m_pid, &status, WNOHANG);
+    } while ((reaped < 0) && (errno == EINTR));
+
+    if (reaped == 0)
+    {
+        return true;
+    }
+
+    if (reaped < 0)
+    {
+        // ECHILD, the worker is gone without a status to report
+        WARN("wait for worker (=%d) failed, error (=%s).", static_cast<int>(m_pid), std::strerror(errno));
+    }
+    else
+    {
+        WARN("worker (=%d) exited, status (=%d).", static_cast<int>(m_pid), status);
+    }
+
+    m_pid = -1;
+    return false;
+}
+
+size_t WorkerProcess::residentBytes() const
+{
+    if (m_pid <= 0)
+    {
+        return 0;
+    }
+
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%d/statm", static_cast<int>(m_pid));
+
+    FILE* statm = std::fopen(path, "r");
+    unsigned long pages(0);
+    unsigned long resident(0);
+
+    if (statm == nullptr)
+    {
+        return 0;
+    }
+
+    const bool read = std::fscanf(statm, "%lu %lu", &pages, &resident) == 2;
+    std::fclose(statm);
+
+    return read ? resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE)) : 0;
+}
+
+void WorkerProcess::terminate(std::chrono::milliseconds const& grace)
+{
+    if (m_pid > 0)
+    {
+        ::kill(m_pid, SIGTERM);
+
+        const auto deadline = std::chrono::steady_clock::now() + grace;
+        int status;
+
+        while (::waitpid(m_pid, &status, WNOHANG) == 0)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                WARN("worker (=%d) ignored SIGTERM, killing it.", static_cast<int>(m_pid));
+                ::kill(m_pid, SIGKILL);
+                ::waitpid(m_pid, &status, 0);
+                break;
+            }
+
+            std::this_thread::sleep_for(REAP_INTERVAL);
+        }
+
+        INFO("worker (=%d) stopped.", static_cast<int>(m_pid));
+        m_pid = -1;
+    }
+
+    if (!m_socketPath.empty())
+    {
+        ::unlink(m_socketPath.c_str());
+    }
+}
+
+pid_t WorkerProcess::pid() const
+{
+    return m_pid;
+}
+
+std::string const& WorkerProcess::socketPath() const
+{
+    return m_socketPath;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * fcgi-gateway: serves HTTP/1.1 from an fcgi server through HttpGateway,
+ * in place of a web server that only translates HTTP to fcgi.
+ */
+
+#include "asio.hpp"
+
+#include "HttpGateway.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <getopt.h>
+
+static void usage()
+{
+    std::fprintf(stderr,
+        "usage: fcgi-gateway [options] PORT tcp:HOST:PORT | unix:PATH\n"
+        "  -t THREADS  executor threads and fcgi connections (default 4)\n"
+        "  -r DIR      document root (default /var/www/html)\n"
+        "  -s SCRIPT   script for every request, such as /var/www/html/index.php\n");
+}
+
+template<typename Protocol>
+static int serve(
+    unsigned short port,
+    typename Protocol::endpoint const& upstream,
+    GatewayConfig const& config
+)
+{
+    HttpGateway<Protocol> gateway(asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port), upstream, config);
+
+    if (!gateway.start())
+    {
+        return EXIT_FAILURE;
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+
+    int received;
+    sigwait(&signals, &received);
+
+    gateway.stop();
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+    GatewayConfig config;
+    int opt;
+
+    while ((opt = ::getopt(argc, argv, "t:r:s:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            config.threads = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 'r':
+            config.documentRoot = optarg;
+            break;
+        case 's':
+            config.scriptFilename = optarg;
+            break;
+        default:
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind + 2 != argc)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    // block the stop signals before any thread starts, sigwait takes them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGPIPE);
+    ::pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    const auto port = static_cast<unsigned short>(std::atoi(argv[optind]));
+    const std::string target(argv[optind + 1]);
+
+    if (target.compare(0, 5, "unix:") == 0)
+    {
+        return serve<asio::local::stream_protocol>(
+            port, asio::local::stream_protocol::endpoint(target.substr(5)), config
+        );
+    }
+
+    const auto colon = target.rfind(':');
+
+    if ((target.compare(0, 4, "tcp:") != 0) || (colon <= 4))
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    return serve<asio::ip::tcp>(
+        port,
+        asio::ip::tcp::endpoint(
+            asio::ip::address::from_string(target.substr(4, colon - 4)),
+            static_cast<unsigned short>(std::atoi(target.c_str() + colon + 1))
+        ),
+        config
+    );
+}
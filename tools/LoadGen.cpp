@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * fcgi-load: open-loop fcgi load generator. Requests are scheduled at a
+ * fixed rate regardless of how fast responses come back, and latency is
+ * measured from the scheduled send time, so a stalled server shows up
+ * in the percentiles instead of silently lowering the offered load
+ * (coordinated omission).
+ */
+
+#include "asio.hpp"
+
+#include "Capture.h"
+#include "Common.h"
+#include "FastCGIClient.h"
+#include "Metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+
+static const std::string SEQ_MARK("{seq}");
+static const double PERCENTILES[] = { 0.5, 0.75, 0.9, 0.99, 0.999, 0.9999, 1.0 };
+
+struct LoadConfig
+{
+    double rate = 1000;
+    std::chrono::seconds duration{ 10 };
+    size_t connections = 4;
+    std::chrono::seconds timeout{ 3 };
+    KeyValuePairs params;
+    std::string body;
+
+    // records the traffic for fcgi-replay, if set
+    std::shared_ptr<TrafficCapture> capture;
+};
+
+struct LoadStats
+{
+    // from the scheduled send time, corrected for coordinated omission
+    LatencyHistogram corrected;
+    // from the actual send time
+    LatencyHistogram service;
+    std::atomic<uint64_t> ok{ 0 };
+    std::atomic<uint64_t> errors{ 0 };
+    std::atomic<uint64_t> timeouts{ 0 };
+    std::atomic<uint64_t> reconnects{ 0 };
+};
+
+static void usage()
+{
+    std::fprintf(stderr,
+        "usage: fcgi-load [options] tcp:HOST:PORT | unix:PATH\n"
+        "  -r RATE   requests per second (default 1000)\n"
+        "  -d SECS   test duration (default 10)\n"
+        "  -c CONNS  connections (default 4)\n"
+        "  -t SECS   request timeout (default 3)\n"
+        "  -p K=V    fcgi param, repeatable; {seq} expands to the request number\n"
+        "  -b BODY   request body template\n"
+        "  -f FILE   request body template read from FILE\n"
+        "  -s BYTES  request body of BYTES filler bytes\n"
+        "  -w FILE   capture the traffic to FILE\n");
+}
+
+static std::string expand(std::string const& text, uint64_t seq)
+{
+    auto pos = text.find(SEQ_MARK);
+
+    if (pos == std::string::npos)
+    {
+        return text;
+    }
+
+    std::string out(text);
+    const auto value = std::to_string(seq);
+
+    while (pos != std::string::npos)
+    {
+        out.replace(pos, SEQ_MARK.size(), value);
+        pos = out.find(SEQ_MARK, pos + value.size());
+    }
+
+    return out;
+}
+
+template<typename Protocol>
+static void runConnection(
+    typename Protocol::endpoint const& endpoint,
+    LoadConfig const& config,
+    std::chrono::steady_clock::time_point start,
+    uint64_t total,
+    std::atomic<uint64_t>& next,
+    LoadStats& stats
+)
+{
+    FastCgiClient<Protocol> client(endpoint);
+
+    if (config.capture)
+    {
+        client.setCapture(config.capture);
+    }
+    const auto interval = std::chrono::duration<double>(1.0 / config.rate);
+
+    while (true)
+    {
+        const auto seq = next.fetch_add(1);
+
+        if (seq >= total)
+        {
+            return;
+        }
+
+        const auto scheduled = start
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval * seq);
+
+        std::this_thread::sleep_until(scheduled);
+
+        if (!client.isOpen())
+        {
+            stats.reconnects.fetch_add(1);
+
+            if (!client.openConnection())
+            {
+                stats.errors.fetch_add(1);
+                continue;
+            }
+        }
+
+        KeyValuePairs pairs;
+        pairs.reserve(config.params.size());
+
+        for (auto const& param : config.params)
+        {
+            pairs.emplace_back(param.first, expand(param.second, seq));
+        }
+
+        std::string response;
+        ReturnCode status;
+
+        const auto sent = std::chrono::steady_clock::now();
+        const bool ok = client.sendRequest(pairs, expand(config.body, seq), response, status, config.timeout);
+        const auto done = std::chrono::steady_clock::now();
+
+        if (!ok)
+        {
+            (status == ReturnCode::TIMEOUT ? stats.timeouts : stats.errors).fetch_add(1);
+            continue;
+        }
+
+        stats.ok.fetch_add(1);
+        stats.corrected.record(std::chrono::duration_cast<std::chrono::microseconds>(done - scheduled));
+        stats.service.record(std::chrono::duration_cast<std::chrono::microseconds>(done - sent));
+    }
+}
+
+template<typename Protocol>
+static void runLoad(
+    typename Protocol::endpoint const& endpoint,
+    LoadConfig const& config,
+    LoadStats& stats
+)
+{
+    const auto total = static_cast<uint64_t>(config.rate * config.duration.count());
+    const auto start = std::chrono::steady_clock::now();
+    std::atomic<uint64_t> next{ 0 };
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < config.connections; ++i)
+    {
+        threads.emplace_back([&] {
+            runConnection<Protocol>(endpoint, config, start, total, next, stats);
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+static void printHistogram(char const* title, HistogramSnapshot const& snapshot)
+{
+    std::printf("%s\n", title);
+
+    for (double q : PERCENTILES)
+    {
+        std::printf("  %8.4f%%  %10.3fms\n", q * 100, snapshot.percentile(q).count() / 1000.0);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    LoadConfig config;
+    int opt;
+
+    while ((opt = ::getopt(argc, argv, "r:d:c:t:p:b:f:s:w:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            config.rate = std::strtod(optarg, nullptr);
+            break;
+        case 'd':
+            config.duration = std::chrono::seconds(std::atoi(optarg));
+            break;
+        case 'c':
+            config.connections = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 't':
+            config.timeout = std::chrono::seconds(std::atoi(optarg));
+            break;
+        case 'p':
+        {
+            const std::string param(optarg);
+            const auto eq = param.find('=');
+
+            if (eq == std::string::npos)
+            {
+                usage();
+                return EXIT_FAILURE;
+            }
+
+            config.params.emplace_back(param.substr(0, eq), param.substr(eq + 1));
+            break;
+        }
+        case 'b':
+            config.body = optarg;
+            break;
+        case 'f':
+        {
+            std::ifstream file(optarg, std::ios::binary);
+
+            if (!file)
+            {
+                std::perror(optarg);
+                return EXIT_FAILURE;
+            }
+
+            config.body.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            break;
+        }
+        case 's':
+            config.body.assign(std::strtoull(optarg, nullptr, 10), 'x');
+            break;
+        case 'w':
+            config.capture = std::make_shared<TrafficCapture>(optarg);
+
+            if (!config.capture->isOpen())
+            {
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ((optind + 1 != argc) || (config.rate <= 0) || (config.connections == 0))
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (config.params.empty())
+    {
+        config.params = {
+            { "REQUEST_METHOD", config.body.empty() ? "GET" : "POST" },
+            { "REQUEST_URI", "/" },
+            { "SCRIPT_FILENAME", "/index.php" },
+        };
+    }
+
+    ILogger::setLevel(ILogger::Level::ERROR_LEVEL);
+
+    const std::string target(argv[optind]);
+    LoadStats stats;
+    const auto start = std::chrono::steady_clock::now();
+
+    if (target.compare(0, 5, "unix:") == 0)
+    {
+        const asio::local::stream_protocol::endpoint endpoint(target.substr(5));
+        runLoad<asio::local::stream_protocol>(endpoint, config, stats);
+    }
+    else if (target.compare(0, 4, "tcp:") == 0)
+    {
+        const auto colon = target.rfind(':');
+
+        if (colon <= 4)
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+
+        const asio::ip::tcp::endpoint endpoint(
+            asio::ip::address::from_string(target.substr(4, colon - 4)),
+            static_cast<unsigned short>(std::atoi(target.c_str() + colon + 1))
+        );
+        runLoad<asio::ip::tcp>(endpoint, config, stats);
+    }
+    else
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf(
+        "%llu ok, %llu errors, %llu timeouts, %llu connects in %.2fs\n"
+        "offered %.1f req/s, achieved %.1f req/s\n",
+        static_cast<unsigned long long>(stats.ok.load()),
+        static_cast<unsigned long long>(stats.errors.load()),
+        static_cast<unsigned long long>(stats.timeouts.load()),
+        static_cast<unsigned long long>(stats.reconnects.load()),
+        elapsed,
+        config.rate,
+        stats.ok.load() / elapsed
+    );
+
+    printHistogram("latency (corrected for coordinated omission)", stats.corrected.snapshot());
+    printHistogram("service time", stats.service.snapshot());
+    return EXIT_SUCCESS;
+}
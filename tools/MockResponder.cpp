@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * fcgi-mock: lightweight local fcgi responder for capacity tests. Each
+ * request is answered after a service time drawn from a configurable
+ * distribution with a response of configurable size, one thread per
+ * connection like a php-fpm worker.
+ */
+
+#include "FcgiCodec.h"
+#include "Sockets.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <signal.h>
+
+static const uint8_t BEGIN_REQUEST = 1;
+static const uint8_t ABORT_REQUEST = 2;
+static const uint8_t END_REQUEST = 3;
+static const uint8_t STDIN = 5;
+static const uint8_t STDOUT = 6;
+static const uint8_t KEEP_CONN = 0x01;
+
+struct MockConfig
+{
+    std::string distribution = "fixed";
+    // fixed: a; uniform: a..b; exp: mean a; lognormal: median a, sigma b
+    double a = 0;
+    double b = 0;
+    size_t responseSize = 1024;
+};
+
+static void usage()
+{
+    std::fprintf(stderr,
+        "usage: fcgi-mock [options] tcp:PORT | unix:PATH | fd:0\n"
+        "  -s DIST   service time in us: fixed:US, uniform:LO:HI,\n"
+        "            exp:MEAN or lognormal:MEDIAN:SIGMA (default fixed:0)\n"
+        "  -n BYTES  response body size (default 1024)\n");
+}
+
+static bool parseDistribution(std::string const& spec, MockConfig& config)
+{
+    const auto colon = spec.find(':');
+
+    if (colon == std::string::npos)
+    {
+        return false;
+    }
+
+    config.distribution = spec.substr(0, colon);
+
+    char* end = nullptr;
+    config.a = std::strtod(spec.c_str() + colon + 1, &end);
+
+    if (*end == ':')
+    {
+        config.b = std::strtod(end + 1, &end);
+    }
+
+    return (*end == '\0') && (config.a >= 0)
+        && ((config.distribution == "fixed") || (config.distribution == "uniform")
+            || (config.distribution == "exp") || (config.distribution == "lognormal"));
+}
+
+static std::chrono::microseconds serviceTime(MockConfig const& config, std::mt19937_64& rng)
+{
+    double us = config.a;
+
+    if (config.distribution == "uniform")
+    {
+        us = std::uniform_real_distribution<double>(config.a, std::max(config.a, config.b))(rng);
+    }
+    else if ((config.distribution == "exp") && (config.a > 0))
+    {
+        us = std::exponential_distribution<double>(1.0 / config.a)(rng);
+    }
+    else if ((config.distribution == "lognormal") && (config.a > 0))
+    {
+        us = std::lognormal_distribution<double>(std::log(config.a), config.b)(rng);
+    }
+
+    return std::chrono::microseconds(static_cast<int64_t>(us));
+}
+
+static std::string endRequest(uint16_t id)
+{
+    return encodeFastCgiRecord(END_REQUEST, std::string(8, '\0'), id);
+}
+
+static void serveConnection(int fd, MockConfig config)
+{
+    std::mt19937_64 rng(std::random_device{}());
+    const std::string body(config.responseSize, 'm');
+    std::string header(FCGI_HEADER_SIZE, '\0');
+    std::vector<char> content;
+    bool keepConn(true);
+
+    while (readFully(fd, &header[0], header.size()))
+    {
+        NameTagPairs fields;
+        decodeFastCgiHeader(header, fields);
+
+        const uint8_t type = static_cast<uint8_t>(fields[TYPE_TOKEN]);
+        const uint16_t id = fields[REQ_ID_TOKEN];
+        const size_t len = fields[CONT_LEN_TOKEN];
+
+        content.resize(len + fields[PADDING_LEN_TOKEN]);
+
+        if (!readFully(fd, content.data(), content.size()))
+        {
+            break;
+        }
+
+        if ((type == BEGIN_REQUEST) && (len >= 3))
+        {
+            keepConn = (content[2] & KEEP_CONN) != 0;
+            continue;
+        }
+
+        if (type == ABORT_REQUEST)
+        {
+            if (!writeFully(fd, endRequest(id)))
+            {
+                break;
+            }
+            continue;
+        }
+
+        // the request is complete at the empty FCGI_STDIN record
+        if ((type != STDIN) || (len > 0))
+        {
+            continue;
+        }
+
+        std::this_thread::sleep_for(serviceTime(config, rng));
+
+        const std::string reply =
+            encodeFastCgiStream(
+                STDOUT,
+                "Status: 200 OK\r\nContent-Type: text/plain\r\n\r\n" + body,
+                id
+            )
+            + encodeFastCgiRecord(STDOUT, std::string(), id)
+            + endRequest(id);
+
+        if (!writeFully(fd, reply) || !keepConn)
+        {
+            break;
+        }
+    }
+
+    ::close(fd);
+}
+
+int main(int argc, char* argv[])
+{
+    MockConfig config;
+    int opt;
+
+    while ((opt = ::getopt(argc, argv, "s:n:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            if (!parseDistribution(optarg, config))
+            {
+                usage();
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'n':
+            config.responseSize = std::strtoull(optarg, nullptr, 10);
+            break;
+        default:
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind + 1 != argc)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    // fd:0 accepts on an inherited socket, as a worker of WorkerPool
+    const std::string target(argv[optind]);
+    const int listener = (target == "fd:0") ? 0 : listenOn(target);
+
+    if (listener < 0)
+    {
+        std::perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+    std::fprintf(stderr, "fcgi-mock listening on %s\n", argv[optind]);
+
+    while (true)
+    {
+        const int fd = ::accept(listener, nullptr, nullptr);
+
+        if (fd >= 0)
+        {
+            std::thread(serveConnection, fd, config).detach();
+        }
+    }
+}
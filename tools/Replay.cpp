@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * fcgi-replay: re-issues the requests of a capture against a target at
+ * the captured times, scaled by a speed factor. Every captured
+ * connection is replayed on its own connection in its original order,
+ * which keeps the concurrency of the captured traffic.
+ */
+
+#include "Capture.h"
+#include "FcgiCodec.h"
+#include "Metrics.h"
+#include "Sockets.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <signal.h>
+
+static const uint8_t END_REQUEST = 3;
+static const double PERCENTILES[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+
+struct ReplayRequest
+{
+    uint16_t requestId = 0;
+    std::chrono::nanoseconds at{ 0 };
+    std::string payload;
+
+    // captured time until FCGI_END_REQUEST, negative if not captured
+    std::chrono::nanoseconds latency{ -1 };
+};
+
+struct ReplayStats
+{
+    LatencyHistogram replayed;
+    LatencyHistogram captured;
+    std::atomic<uint64_t> ok{ 0 };
+    std::atomic<uint64_t> errors{ 0 };
+};
+
+static void usage()
+{
+    std::fprintf(stderr,
+        "usage: fcgi-replay [options] CAPTURE tcp:HOST:PORT | unix:PATH\n"
+        "  -x SPEED  replay speed factor, 2 replays twice as fast (default 1)\n");
+}
+
+// requests of each captured connection, with their captured latency
+static std::map<uint32_t, std::vector<ReplayRequest>> groupByConnection(
+    std::vector<CapturedEvent>& events
+)
+{
+    std::map<uint32_t, std::vector<ReplayRequest>> lanes;
+
+    for (auto& event : events)
+    {
+        auto& lane = lanes[event.connection];
+
+        if (event.event == CaptureEvent::REQUEST)
+        {
+            ReplayRequest request;
+            request.requestId = event.requestId;
+            request.at = event.at;
+            request.payload = std::move(event.payload);
+            lane.push_back(std::move(request));
+        }
+        else if (!lane.empty() && (lane.back().requestId == event.requestId)
+            && (event.payload.size() >= FCGI_HEADER_SIZE)
+            && (static_cast<uint8_t>(event.payload[1]) == END_REQUEST))
+        {
+            lane.back().latency = event.at - lane.back().at;
+        }
+    }
+
+    return lanes;
+}
+
+// reads records until FCGI_END_REQUEST of requestId
+static bool awaitEnd(int fd, uint16_t requestId)
+{
+    std::string header(FCGI_HEADER_SIZE, '\0');
+    std::string content;
+
+    while (readFully(fd, &header[0], header.size()))
+    {
+        NameTagPairs fields;
+        decodeFastCgiHeader(header, fields);
+        content.resize(fields[CONT_LEN_TOKEN] + fields[PADDING_LEN_TOKEN]);
+
+        if (!content.empty() && !readFully(fd, &content[0], content.size()))
+        {
+            return false;
+        }
+
+        if ((fields[TYPE_TOKEN] == END_REQUEST) && (fields[REQ_ID_TOKEN] == requestId))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void replayLane(
+    std::string const& target,
+    std::vector<ReplayRequest> const& lane,
+    std::chrono::steady_clock::time_point start,
+    std::chrono::nanoseconds base,
+    double speed,
+    ReplayStats& stats
+)
+{
+    int fd(-1);
+
+    for (auto const& request : lane)
+    {
+        const auto scheduled = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::nano>((request.at - base).count() / speed)
+        );
+
+        std::this_thread::sleep_until(scheduled);
+
+        if ((fd < 0) && ((fd = connectTo(target)) < 0))
+        {
+            stats.errors.fetch_add(1);
+            continue;
+        }
+
+        if (!writeFully(fd, request.payload) || !awaitEnd(fd, request.requestId))
+        {
+            stats.errors.fetch_add(1);
+            ::close(fd);
+            fd = -1;
+            continue;
+        }
+
+        stats.ok.fetch_add(1);
+        stats.replayed.record(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - scheduled
+        ));
+
+        if (request.latency.count() >= 0)
+        {
+            stats.captured.record(std::chrono::duration_cast<std::chrono::microseconds>(request.latency));
+        }
+    }
+
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+static void printHistograms(ReplayStats const& stats)
+{
+    const auto replayed = stats.replayed.snapshot();
+    const auto captured = stats.captured.snapshot();
+
+    std::printf("  percentile     captured     replayed\n");
+
+    for (double q : PERCENTILES)
+    {
+        std::printf(
+            "  %9.3f%%  %9.3fms  %9.3fms\n",
+            q * 100,
+            captured.percentile(q).count() / 1000.0,
+            replayed.percentile(q).count() / 1000.0
+        );
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    double speed(1.0);
+    int opt;
+
+    while ((opt = ::getopt(argc, argv, "x:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'x':
+            speed = std::strtod(optarg, nullptr);
+            break;
+        default:
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ((optind + 2 != argc) || (speed <= 0))
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    std::vector<CapturedEvent> events;
+
+    if (!TrafficCapture::load(argv[optind], events))
+    {
+        return EXIT_FAILURE;
+    }
+
+    const auto lanes = groupByConnection(events);
+    std::chrono::nanoseconds base(std::chrono::nanoseconds::max());
+    size_t total(0);
+
+    for (auto const& lane : lanes)
+    {
+        if (!lane.second.empty())
+        {
+            base = std::min(base, lane.second.front().at);
+            total += lane.second.size();
+        }
+    }
+
+    std::printf("replaying %zu requests on %zu connections at %.2fx\n", total, lanes.size(), speed);
+    ::signal(SIGPIPE, SIG_IGN);
+
+    const std::string target(argv[optind + 1]);
+    const auto start = std::chrono::steady_clock::now();
+    ReplayStats stats;
+    std::vector<std::thread> threads;
+
+    for (auto const& lane : lanes)
+    {
+        if (!lane.second.empty())
+        {
+            threads.emplace_back(
+                replayLane, std::cref(target), std::cref(lane.second), start, base, speed, std::ref(stats)
+            );
+        }
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    std::printf(
+        "%llu ok, %llu errors in %.2fs\n",
+        static_cast<unsigned long long>(stats.ok.load()),
+        static_cast<unsigned long long>(stats.errors.load()),
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+    );
+
+    printHistograms(stats);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2020-2021 Purple Hyacinth Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission from
+ *    the author.
+ *
+ * 4. Products derived from this software may not be called "Purple Hyacinth"
+ *    nor may "Purple Hyacinth" appear in their names without specific prior
+ *    written permission from the author.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TOOLS_SOCKETS_H_
+#define TOOLS_SOCKETS_H_
+
+/*
+ * blocking socket helpers shared by the tools. Targets are written as
+ * tcp:HOST:PORT or unix:PATH, listeners as tcp:PORT or unix:PATH.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+inline bool readFully(int fd, char* buf, size_t len)
+{
+    while (len > 0)
+    {
+        const auto got = ::read(fd, buf, len);
+
+        if (got <= 0)
+        {
+            return false;
+        }
+
+        buf += got;
+        len -= static_cast<size_t>(got);
+    }
+
+    return true;
+}
+
+inline bool writeFully(int fd, std::string const& data)
+{
+    size_t pos(0);
+
+    while (pos < data.size())
+    {
+        const auto put = ::write(fd, data.data() + pos, data.size() - pos);
+
+        if (put <= 0)
+        {
+            return false;
+        }
+
+        pos += static_cast<size_t>(put);
+    }
+
+    return true;
+}
+
+inline int listenOn(std::string const& target)
+{
+    int fd(-1);
+
+    if (target.compare(0, 5, "unix:") == 0)
+    {
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        std::snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", target.c_str() + 5);
+        ::unlink(addr.sun_path);
+
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if ((fd >= 0) && (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0))
+        {
+            ::close(fd);
+            return -1;
+        }
+    }
+    else if (target.compare(0, 4, "tcp:") == 0)
+    {
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(static_cast<uint16_t>(std::atoi(target.c_str() + 4)));
+
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        const int on(1);
+
+        if ((fd >= 0)
+            && ((::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0)
+                || (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)))
+        {
+            ::close(fd);
+            return -1;
+        }
+    }
+
+    if ((fd >= 0) && (::listen(fd, SOMAXCONN) != 0))
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+inline int connectTo(std::string const& target)
+{
+    int fd(-1);
+
+    if (target.compare(0, 5, "unix:") == 0)
+    {
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        std::snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", target.c_str() + 5);
+
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if ((fd >= 0) && (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0))
+        {
+            ::close(fd);
+            return -1;
+        }
+    }
+    else if (target.compare(0, 4, "tcp:") == 0)
+    {
+        const auto colon = target.rfind(':');
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(std::atoi(target.c_str() + colon + 1)));
+
+        if ((colon <= 4)
+            || (::inet_pton(AF_INET, target.substr(4, colon - 4).c_str(), &addr.sin_addr) != 1))
+        {
+            return -1;
+        }
+
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        const int on(1);
+
+        if ((fd >= 0)
+            && ((::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) != 0)
+                || (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)))
+        {
+            ::close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+#endif /* TOOLS_SOCKETS_H_ */